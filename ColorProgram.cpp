@@ -3,32 +3,34 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
+static SubmittedProgram submitted_program("ColorProgram",
+	//vertex shader:
+	"#version 330\n"
+	"uniform mat4 OBJECT_TO_CLIP;\n"
+	"in vec4 Position;\n"
+	"in vec4 Color;\n"
+	"out vec4 color;\n"
+	"void main() {\n"
+	"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+	"	color = Color;\n"
+	"}\n"
+,
+	//fragment shader:
+	"#version 330\n"
+	"in vec4 color;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragColor = color;\n"
+	"}\n"
+);
+//As you can see above, adjacent strings in C/C++ are concatenated.
+// this is very useful for writing long shader programs inline.
+
 Load< ColorProgram > color_program(LoadTagEarly);
 
 ColorProgram::ColorProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"in vec4 Position;\n"
-		"in vec4 Color;\n"
-		"out vec4 color;\n"
-		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	color = Color;\n"
-		"}\n"
-	,
-		//fragment shader:
-		"#version 330\n"
-		"in vec4 color;\n"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	fragColor = color;\n"
-		"}\n"
-	);
-	//As you can see above, adjacent strings in C/C++ are concatenated.
-	// this is very useful for writing long shader programs inline.
+	//wait for the program submitted above to finish compiling (throws on errors):
+	program = submitted_program.finish();
 
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
@@ -3,37 +3,39 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
+static SubmittedProgram submitted_program("ColorTextureProgram",
+	//vertex shader:
+	"#version 330\n"
+	"uniform mat4 OBJECT_TO_CLIP;\n"
+	"in vec4 Position;\n"
+	"in vec4 Color;\n"
+	"in vec2 TexCoord;\n"
+	"out vec4 color;\n"
+	"out vec2 texCoord;\n"
+	"void main() {\n"
+	"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+	"	color = Color;\n"
+	"	texCoord = TexCoord;\n"
+	"}\n"
+,
+	//fragment shader:
+	"#version 330\n"
+	"uniform sampler2D TEX;\n"
+	"in vec4 color;\n"
+	"in vec2 texCoord;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragColor = texture(TEX, texCoord) * color;\n"
+	"}\n"
+);
+//As you can see above, adjacent strings in C/C++ are concatenated.
+// this is very useful for writing long shader programs inline.
+
 Load< ColorTextureProgram > color_texture_program(LoadTagEarly);
 
 ColorTextureProgram::ColorTextureProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"in vec4 Position;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
-		"out vec4 color;\n"
-		"out vec2 texCoord;\n"
-		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	color = Color;\n"
-		"	texCoord = TexCoord;\n"
-		"}\n"
-	,
-		//fragment shader:
-		"#version 330\n"
-		"uniform sampler2D TEX;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	fragColor = texture(TEX, texCoord) * color;\n"
-		"}\n"
-	);
-	//As you can see above, adjacent strings in C/C++ are concatenated.
-	// this is very useful for writing long shader programs inline.
+	//wait for the program submitted above to finish compiling (throws on errors):
+	program = submitted_program.finish();
 
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
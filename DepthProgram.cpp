@@ -0,0 +1,90 @@
+#include "DepthProgram.hpp"
+
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+#include "ShaderWatcher.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+DepthProgram::DepthProgram(GLuint position_location) {
+	program = gl_finish_program(gl_submit_program("DepthProgram (Position at " + std::to_string(position_location) + ")",
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4 OBJECT_TO_CLIP;\n"
+		"layout(location = " + std::to_string(position_location) + ") in vec4 Position;\n"
+		"invariant gl_Position;\n" //(so depth pre-passes match the color pass exactly)
+		"void main() {\n"
+		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"void main() {\n"
+		"}\n"
+	));
+
+	Position_vec4 = position_location;
+
+	//look up the locations of uniforms:
+	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
+}
+
+DepthProgram::~DepthProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
+
+DepthProgram const *depth_program_for(GLuint program) {
+	static std::unordered_map< GLuint, GLint > position_locations; //program -> Position location
+	static std::map< GLint, std::unique_ptr< DepthProgram > > depth_programs; //Position location -> program
+
+	//hot-reloading deletes old programs, and GL may hand their names out again, so forget about both:
+	static uint32_t listener = add_shader_reload_listener([](GLuint old_program, GLuint new_program) {
+		position_locations.erase(old_program);
+		position_locations.erase(new_program);
+	});
+	(void)listener;
+
+	auto f = position_locations.find(program);
+	if (f == position_locations.end()) {
+		f = position_locations.emplace(program, glGetAttribLocation(program, "Position")).first;
+	}
+	if (f->second < 0) return nullptr;
+
+	auto &ret = depth_programs[f->second];
+	if (!ret) ret.reset(new DepthProgram(GLuint(f->second)));
+	return ret.get();
+}
+
+void draw_depth(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > const &drawables) {
+	GLuint current = 0;
+	for (Scene::Drawable const *drawable : drawables) {
+		Scene::Drawable::Pipeline const &pipeline = drawable->pipeline;
+		if (pipeline.program == 0 || pipeline.vao == 0 || pipeline.count == 0) continue;
+
+		DepthProgram const *depth = depth_program_for(pipeline.program);
+		if (!depth) continue;
+		if (depth->program != current) {
+			glUseProgram(depth->program);
+			current = depth->program;
+		}
+
+		glBindVertexArray(pipeline.vao);
+
+		assert(drawable->transform);
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(drawable->transform->make_local_to_world());
+		glUniformMatrix4fv(depth->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+
+		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+	}
+
+	glUseProgram(0);
+	glBindVertexArray(0);
+
+	GL_ERRORS();
+}
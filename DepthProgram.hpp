@@ -0,0 +1,30 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <vector>
+
+//Shader program that only writes depth (for shadow maps and depth pre-passes):
+// drawables' vertex arrays are made for their own programs, so there is one DepthProgram
+// for each location the "Position" attribute ends up at; these are made when first needed.
+struct DepthProgram {
+	DepthProgram(GLuint position_location);
+	~DepthProgram();
+
+	GLuint program = 0;
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+	//Uniform (per-invocation variable) locations:
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	//Textures:
+	// none
+};
+
+//depth program that reads Position from the same attribute location as 'program' does:
+// (returns nullptr if 'program' has no Position attribute)
+DepthProgram const *depth_program_for(GLuint program);
+
+//draw the depth of 'drawables' (skipping ones without program, vertex array, or vertices):
+// (uses whatever framebuffer, viewport, and depth state are current)
+void draw_depth(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > const &drawables);
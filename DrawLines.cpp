@@ -1,59 +1,121 @@
 #include "DrawLines.hpp"
 #include "PathFont.hpp"
-#include "ColorProgram.hpp"
+#include "LinesProgram.hpp"
 
 #include "gl_errors.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <array>
+#include <cstring>
+#include <unordered_map>
+
 //All DrawLines instances share a vertex array object and vertex buffer, initialized at load time:
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
 static GLuint vertex_buffer = 0;
-static GLuint vertex_buffer_for_color_program = 0;
+static GLuint vertex_buffer_for_lines_program = 0;
+
+//vertex_buffer is used as a streaming ring buffer, split into sections:
+// instances are written (unsynchronized) into the current section, and when the ring moves on
+// to the next section it first waits on a fence set when that section was last used.
+// With three sections, the GPU has a couple of sections' worth of draws to finish before any waiting happens.
+static constexpr uint32_t const RING_SECTIONS = 3;
+static GLsizeiptr ring_section_size = 1 << 20; //bytes; grows if a single DrawLines needs more
+static uint32_t ring_section = 0; //section currently being written
+static GLsizeiptr ring_offset = 0; //next free byte in current section
+static std::array< GLsync, RING_SECTIONS > ring_fences = {}; //fence for each section (0 if none)
+
+//segment and box vectors are recycled so that (after the first few frames) DrawLines doesn't allocate:
+static std::vector< std::vector< DrawLines::Segment > > segments_pool;
+static std::vector< std::vector< DrawLines::Box > > boxes_pool;
+
+//draw_text remembers the line segments for recently-drawn strings, in text (x,y) coordinates:
+struct TextLines {
+	std::vector< glm::vec2 > coords; //pairs of endpoints
+	float width = 0.0f; //total advance, in units of x
+};
+static std::unordered_map< std::string, TextLines > text_lines_cache;
+static constexpr size_t const TEXT_LINES_CACHE_MAX = 1024; //cache is cleared when it gets bigger than this
+
+static void allocate_ring() {
+	for (auto &fence : ring_fences) {
+		if (fence) glDeleteSync(fence);
+		fence = 0;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, RING_SECTIONS * ring_section_size, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	ring_section = 0;
+	ring_offset = 0;
+}
 
-static Load< void > setup_buffers(LoadTagDefault, [](){
-	//you may recognize this init code from DrawSprites.cpp:
+//copy 'size' bytes into the ring buffer, returning their offset in vertex_buffer:
+static GLintptr upload_to_ring(void const *data, GLsizeiptr size) {
+	//make sure data fits in one ring section:
+	if (size > ring_section_size) {
+		while (size > ring_section_size) ring_section_size *= 2;
+		//(re-specifying the buffer lets the driver hand us new storage without waiting for old draws)
+		allocate_ring();
+	}
+
+	//move to the next section if needed:
+	if (ring_offset + size > ring_section_size) {
+		//mark the end of draws from this section:
+		assert(ring_fences[ring_section] == 0);
+		ring_fences[ring_section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		ring_section = (ring_section + 1) % RING_SECTIONS;
+		ring_offset = 0;
+
+		//wait for the GPU to be done with the next section (usually it already is):
+		if (ring_fences[ring_section]) {
+			GLenum result = glClientWaitSync(ring_fences[ring_section], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+				//PARANOIA: if waiting fails, fall back to letting the driver sort things out:
+				allocate_ring();
+			}
+			if (ring_fences[ring_section]) glDeleteSync(ring_fences[ring_section]);
+			ring_fences[ring_section] = 0;
+		}
+	}
 
+	//copy data into vertex_buffer (no synchronization needed -- fences guarantee the GPU isn't reading this range):
+	GLintptr offset = GLintptr(ring_section) * ring_section_size + ring_offset;
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
+	void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (dst) {
+		std::memcpy(dst, data, size_t(size));
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//next upload goes after this one (kept 16-byte aligned):
+	ring_offset += (size + 15) / 16 * 16;
+
+	return offset;
+}
+
+static Load< void > setup_buffers(LoadTagDefault, [](){
 	{ //set up vertex buffer:
 		glGenBuffers(1, &vertex_buffer);
-		//for now, buffer will be un-filled.
+		allocate_ring();
 	}
 
-	{ //vertex array mapping buffer for color_program:
-		//ask OpenGL to fill vertex_buffer_for_color_program with the name of an unused vertex array object:
-		glGenVertexArrays(1, &vertex_buffer_for_color_program);
-
-		//set vertex_buffer_for_color_program as the current vertex array object:
-		glBindVertexArray(vertex_buffer_for_color_program);
-
-		//set vertex_buffer as the source of glVertexAttribPointer() commands:
-		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-
-		//set up the vertex array object to describe arrays of PongMode::Vertex:
-		glVertexAttribPointer(
-			color_program->Position_vec4, //attribute
-			3, //size
-			GL_FLOAT, //type
-			GL_FALSE, //normalized
-			sizeof(DrawLines::Vertex), //stride
-			(GLbyte *)0 + offsetof(DrawLines::Vertex, Position) //offset
-		);
-		glEnableVertexAttribArray(color_program->Position_vec4);
-		//[Note that it is okay to bind a vec3 input to a vec4 attribute -- the w component will be filled with 1.0 automatically]
-
-		glVertexAttribPointer(
-			color_program->Color_vec4, //attribute
-			4, //size
-			GL_UNSIGNED_BYTE, //type
-			GL_TRUE, //normalized
-			sizeof(DrawLines::Vertex), //stride
-			(GLbyte *)0 + offsetof(DrawLines::Vertex, Color) //offset
-		);
-		glEnableVertexAttribArray(color_program->Color_vec4);
-
-		//done referring to vertex_buffer, so unbind it:
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	{ //vertex array for lines_program:
+		// (attribute pointers are set when drawing, since data lands at a different offset in vertex_buffer each time)
+		glGenVertexArrays(1, &vertex_buffer_for_lines_program);
+		glBindVertexArray(vertex_buffer_for_lines_program);
+
+		//every attribute is per-instance:
+		for (GLuint attrib : {
+			lines_program->A_vec3, lines_program->B_vec3,
+			lines_program->Box0_vec3, lines_program->Box1_vec3, lines_program->Box2_vec3, lines_program->Box3_vec3,
+			lines_program->Color_vec4 }) {
+			glVertexAttribDivisor(attrib, 1);
+		}
 
 		//done setting up vertex array object, so unbind it:
 		glBindVertexArray(0);
@@ -62,103 +124,144 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
 });
 
+//helper: point a per-instance attribute at 'offset' in vertex_buffer (which should be bound):
+static void instance_attrib(GLuint attrib, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLintptr offset) {
+	glVertexAttribPointer(attrib, size, type, normalized, stride, (GLbyte *)0 + offset);
+	glEnableVertexAttribArray(attrib);
+}
+
 
 DrawLines::DrawLines(glm::mat4 const &world_to_clip_) : world_to_clip(world_to_clip_) {
+	if (!segments_pool.empty()) {
+		segments = std::move(segments_pool.back());
+		segments_pool.pop_back();
+		segments.clear();
+	}
+	if (!boxes_pool.empty()) {
+		boxes = std::move(boxes_pool.back());
+		boxes_pool.pop_back();
+		boxes.clear();
+	}
 }
 
 void DrawLines::draw(glm::vec3 const &a, glm::vec3 const &b, glm::u8vec4 const &color) {
-	attribs.emplace_back(a, color);
-	attribs.emplace_back(b, color);
+	segments.emplace_back(a, b, color);
 }
 
 void DrawLines::draw_box(glm::mat4x3 const &mat, glm::u8vec4 const &color) {
-	//draw cube as three edge sets:
-
-	draw(mat * glm::vec4(-1.0f,-1.0f,-1.0f, 1.0f), mat * glm::vec4( 1.0f,-1.0f,-1.0f, 1.0f), color);
-	draw(mat * glm::vec4(-1.0f, 1.0f,-1.0f, 1.0f), mat * glm::vec4( 1.0f, 1.0f,-1.0f, 1.0f), color);
-	draw(mat * glm::vec4(-1.0f,-1.0f, 1.0f, 1.0f), mat * glm::vec4( 1.0f,-1.0f, 1.0f, 1.0f), color);
-	draw(mat * glm::vec4(-1.0f, 1.0f, 1.0f, 1.0f), mat * glm::vec4( 1.0f, 1.0f, 1.0f, 1.0f), color);
-
-	draw(mat * glm::vec4(-1.0f,-1.0f,-1.0f, 1.0f), mat * glm::vec4(-1.0f, 1.0f,-1.0f, 1.0f), color);
-	draw(mat * glm::vec4( 1.0f,-1.0f,-1.0f, 1.0f), mat * glm::vec4( 1.0f, 1.0f,-1.0f, 1.0f), color);
-	draw(mat * glm::vec4(-1.0f,-1.0f, 1.0f, 1.0f), mat * glm::vec4(-1.0f, 1.0f, 1.0f, 1.0f), color);
-	draw(mat * glm::vec4( 1.0f,-1.0f, 1.0f, 1.0f), mat * glm::vec4( 1.0f, 1.0f, 1.0f, 1.0f), color);
-	
-	draw(mat * glm::vec4(-1.0f,-1.0f,-1.0f, 1.0f), mat * glm::vec4(-1.0f,-1.0f, 1.0f, 1.0f), color);
-	draw(mat * glm::vec4( 1.0f,-1.0f,-1.0f, 1.0f), mat * glm::vec4( 1.0f,-1.0f, 1.0f, 1.0f), color);
-	draw(mat * glm::vec4(-1.0f, 1.0f,-1.0f, 1.0f), mat * glm::vec4(-1.0f, 1.0f, 1.0f, 1.0f), color);
-	draw(mat * glm::vec4( 1.0f, 1.0f,-1.0f, 1.0f), mat * glm::vec4( 1.0f, 1.0f, 1.0f, 1.0f), color);
+	//the cube's edges are built from the matrix in the vertex shader:
+	boxes.emplace_back(mat, color);
 }
 
 void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, glm::vec3 const &x, glm::vec3 const &y, glm::u8vec4 const &color, glm::vec3 *anchor_out) {
 
-	glm::vec3 anchor = anchor_in;
-
-	uint32_t start = 0;
-	while (start < text.size()) {
-		uint32_t end = start;
-		uint32_t glyph = -1U;
-		while (end < text.size()) {
-			end += 1;
-			auto f = PathFont::font.glyph_map.find(text.substr(start, end-start));
-			if (f == PathFont::font.glyph_map.end()) {
-				end -= 1;
-				break;
-			}
-			glyph = f->second;
-		}
-		if (glyph == -1U) {
-			assert(start == end);
-			end += 1;
-			//missing! draw a tofu:
-			for (const auto &pt : {
-				glm::vec2(0.1f, 0.1f), glm::vec2(0.6f, 0.1f),
-				glm::vec2(0.6f, 0.1f), glm::vec2(0.6f, 0.9f),
-				glm::vec2(0.9f, 0.6f), glm::vec2(0.1f, 0.9f),
-				glm::vec2(0.1f, 0.9f), glm::vec2(0.1f, 0.1f)
-			}) {
-				attribs.emplace_back(anchor + pt.x * x + pt.y * y, color);
+	auto f = text_lines_cache.find(text);
+	if (f == text_lines_cache.end()) {
+		if (text_lines_cache.size() >= TEXT_LINES_CACHE_MAX) text_lines_cache.clear();
+		f = text_lines_cache.emplace(text, TextLines()).first;
+		TextLines &lines = f->second;
+
+		//lay out text in (x,y) units:
+		float advance = 0.0f;
+		size_t start = 0;
+		while (start < text.size()) {
+			size_t matched = 0;
+			uint32_t glyph = PathFont::font.match(text.c_str() + start, text.size() - start, &matched);
+			if (glyph == -1U) {
+				matched = 1;
+				//missing! draw a tofu:
+				for (const auto &pt : {
+					glm::vec2(0.1f, 0.1f), glm::vec2(0.6f, 0.1f),
+					glm::vec2(0.6f, 0.1f), glm::vec2(0.6f, 0.9f),
+					glm::vec2(0.9f, 0.6f), glm::vec2(0.1f, 0.9f),
+					glm::vec2(0.1f, 0.9f), glm::vec2(0.1f, 0.1f)
+				}) {
+					lines.coords.emplace_back(advance + pt.x, pt.y);
+				}
+				advance += 0.6f;
+			} else {
+				for (uint32_t c = PathFont::font.glyph_coord_starts[glyph]; c + 1 < PathFont::font.glyph_coord_starts[glyph+1]; c += 2) {
+					lines.coords.emplace_back(advance + PathFont::font.coords[c], PathFont::font.coords[c+1]);
+				}
+				advance += PathFont::font.glyph_widths[glyph];
 			}
-			anchor += x * 0.6f;
-		} else {
-			for (uint32_t c = PathFont::font.glyph_coord_starts[glyph]; c + 1 < PathFont::font.glyph_coord_starts[glyph+1]; c += 2) {
-				attribs.emplace_back(anchor + x * PathFont::font.coords[c] + y * PathFont::font.coords[c+1], color);
-			}
-			anchor += x * PathFont::font.glyph_widths[glyph];
+			start += matched;
 		}
-		start = end;
+		lines.width = advance;
 	}
 
-	if (anchor_out) *anchor_out = anchor;
+	TextLines const &lines = f->second;
+
+	//transform cached line segments into place:
+	size_t base = segments.size();
+	segments.resize(base + lines.coords.size() / 2, Segment(anchor_in, anchor_in, color));
+	Segment *out = segments.data() + base;
+	for (size_t i = 0; i + 1 < lines.coords.size(); i += 2) {
+		out->a = anchor_in + lines.coords[i].x * x + lines.coords[i].y * y;
+		out->b = anchor_in + lines.coords[i+1].x * x + lines.coords[i+1].y * y;
+		++out;
+	}
+
+	if (anchor_out) *anchor_out = anchor_in + x * lines.width;
 }
 
 DrawLines::~DrawLines() {
-	if (attribs.empty()) return;
-
-	//based on DrawSprites.cpp :
+	if (!segments.empty() || !boxes.empty()) {
+		//thickness is in pixels, so the shader needs the viewport size:
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+
+		glUseProgram(lines_program->program);
+		glUniformMatrix4fv(lines_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+		glUniform2f(lines_program->VIEWPORT_vec2, float(viewport[2]), float(viewport[3]));
+		glUniform1f(lines_program->THICKNESS_float, thickness);
+
+		glBindVertexArray(vertex_buffer_for_lines_program);
+
+		if (!segments.empty()) {
+			GLintptr offset = upload_to_ring(segments.data(), GLsizeiptr(segments.size() * sizeof(Segment)));
+
+			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+			instance_attrib(lines_program->A_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(Segment), offset + offsetof(Segment, a));
+			instance_attrib(lines_program->B_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(Segment), offset + offsetof(Segment, b));
+			instance_attrib(lines_program->Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Segment), offset + offsetof(Segment, color));
+			glDisableVertexAttribArray(lines_program->Box0_vec3);
+			glDisableVertexAttribArray(lines_program->Box1_vec3);
+			glDisableVertexAttribArray(lines_program->Box2_vec3);
+			glDisableVertexAttribArray(lines_program->Box3_vec3);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			glUniform1i(lines_program->BOXES_bool, GL_FALSE);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6, GLsizei(segments.size()));
+		}
 
-	//upload vertices to vertex_buffer:
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (!boxes.empty()) {
+			GLintptr offset = upload_to_ring(boxes.data(), GLsizeiptr(boxes.size() * sizeof(Box)));
 
-	//set color_program as current program:
-	glUseProgram(color_program->program);
+			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+			for (uint32_t c = 0; c < 4; ++c) {
+				GLuint attrib = (c == 0 ? lines_program->Box0_vec3 : c == 1 ? lines_program->Box1_vec3 : c == 2 ? lines_program->Box2_vec3 : lines_program->Box3_vec3);
+				instance_attrib(attrib, 3, GL_FLOAT, GL_FALSE, sizeof(Box), offset + offsetof(Box, mat) + c * sizeof(glm::vec3));
+			}
+			instance_attrib(lines_program->Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Box), offset + offsetof(Box, color));
+			glDisableVertexAttribArray(lines_program->A_vec3);
+			glDisableVertexAttribArray(lines_program->B_vec3);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	//upload OBJECT_TO_CLIP to the proper uniform location:
-	glUniformMatrix4fv(color_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+			glUniform1i(lines_program->BOXES_bool, GL_TRUE);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6 * 12, GLsizei(boxes.size()));
+		}
 
-	//use the mapping vertex_buffer_for_color_program to fetch vertex data:
-	glBindVertexArray(vertex_buffer_for_color_program);
+		//reset vertex array to none:
+		glBindVertexArray(0);
 
-	//run the OpenGL pipeline:
-	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
+		//reset current program to none:
+		glUseProgram(0);
 
-	//reset vertex array to none:
-	glBindVertexArray(0);
+		GL_ERRORS();
+	}
 
-	//reset current program to none:
-	glUseProgram(0);
+	//hand vectors back for a later DrawLines to use:
+	segments_pool.emplace_back(std::move(segments));
+	boxes_pool.emplace_back(std::move(boxes));
 }
-
-
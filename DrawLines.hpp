@@ -4,6 +4,8 @@
  * Helper class for simple immediate-mode drawing of lines -- mostly intended for
  * DEBUG output and quick tests.
  *
+ * Lines are drawn 'thickness' pixels wide, using instanced quads (see LinesProgram).
+ *
  * Similar usage pattern to DrawSprites.
  *
  */
@@ -38,11 +40,23 @@ struct DrawLines {
 
 
 	glm::mat4 world_to_clip;
-	struct Vertex {
-		Vertex(glm::vec3 const &Position_, glm::u8vec4 const &Color_) : Position(Position_), Color(Color_) { }
-		glm::vec3 Position;
-		glm::u8vec4 Color;
+
+	//line width, in pixels:
+	float thickness = 1.0f;
+
+	//lines are drawn as instances (see LinesProgram), expanded to quads in the vertex shader:
+	struct Segment {
+		Segment(glm::vec3 const &a_, glm::vec3 const &b_, glm::u8vec4 const &color_) : a(a_), b(b_), color(color_) { }
+		glm::vec3 a, b;
+		glm::u8vec4 color;
+	};
+	std::vector< Segment > segments;
+
+	struct Box {
+		Box(glm::mat4x3 const &mat_, glm::u8vec4 const &color_) : mat(mat_), color(color_) { }
+		glm::mat4x3 mat;
+		glm::u8vec4 color;
 	};
-	std::vector< Vertex > attribs;
+	std::vector< Box > boxes;
 
 };
@@ -0,0 +1,89 @@
+#include "DrawPasses.hpp"
+
+#include "gl_errors.hpp"
+
+#include <cassert>
+
+DrawPasses::DrawPasses() {
+	for (auto &slot : slots) {
+		glGenQueries(PassCount, slot.queries);
+	}
+	GL_ERRORS();
+}
+
+DrawPasses::~DrawPasses() {
+	for (auto &slot : slots) {
+		glDeleteQueries(PassCount, slot.queries);
+		for (auto &query : slot.queries) query = 0;
+	}
+}
+
+void DrawPasses::begin(Pass pass) {
+	assert(pass < PassCount);
+	if (!drawing) {
+		drawing = true;
+		collect();
+		//use the oldest slot, unless the GPU hasn't gotten around to it yet:
+		Slot &slot = slots[serial % Slots];
+		if (slot.pending) {
+			current = nullptr;
+		} else {
+			current = &slot;
+			for (auto &used : slot.used) used = false;
+		}
+	}
+	if (!current) return;
+	assert(!current->used[pass] && "each pass is timed at most once per draw");
+	current->used[pass] = true;
+	glBeginQuery(GL_TIME_ELAPSED, current->queries[pass]);
+}
+
+void DrawPasses::end(Pass pass) {
+	assert(pass < PassCount);
+	assert(drawing);
+	if (!current) return;
+	assert(current->used[pass]);
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+void DrawPasses::finish() {
+	if (!drawing) return;
+	if (current) {
+		current->pending = true;
+		current->serial = serial;
+	}
+	++serial;
+	drawing = false;
+	current = nullptr;
+
+	collect();
+}
+
+void DrawPasses::collect() {
+	for (auto &slot : slots) {
+		if (!slot.pending) continue;
+
+		bool available = true;
+		for (uint32_t p = 0; p < PassCount; ++p) {
+			if (!slot.used[p]) continue;
+			GLint result = GL_FALSE;
+			glGetQueryObjectiv(slot.queries[p], GL_QUERY_RESULT_AVAILABLE, &result);
+			if (result == GL_FALSE) {
+				available = false;
+				break;
+			}
+		}
+		if (!available) continue;
+
+		slot.pending = false;
+		if (slot.serial + 1 <= reported) continue; //already have newer results
+
+		for (uint32_t p = 0; p < PassCount; ++p) {
+			GLuint64 elapsed = 0;
+			if (slot.used[p]) glGetQueryObjectui64v(slot.queries[p], GL_QUERY_RESULT, &elapsed);
+			stats.gpu_ms[p] = double(elapsed) / 1.0e6;
+		}
+		reported = slot.serial + 1;
+	}
+	if (reported) stats.frames_behind = serial - reported;
+}
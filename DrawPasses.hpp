@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * Scene::draw always draws opaque drawables (with blending off) before blended ones (Pipeline::blend),
+ * which it draws farthest-first with depth writes off.
+ *
+ * DrawPasses tells Scene::draw how to order the opaque drawables, and keeps track of how long (on the GPU) each pass took:
+ *  - with 'depth_prepass' set, the depths of opaque drawables whose pipelines promise an invariant_position
+ *    are drawn first (with a position-only DepthProgram),
+ *    and the (expensive) color pass then runs with GL_EQUAL depth testing and depth writes off,
+ *    so each pixel is shaded only once
+ *  - with 'sort_front_to_back' set, opaque drawables are drawn nearest-first, so (even without a pre-pass)
+ *    most hidden fragments fail the depth test before shading
+ *
+ * GPU times come from GL_TIME_ELAPSED queries that are only read once their results are available
+ * (usually a frame or two later), so timing never stalls the pipeline.
+ *
+ */
+
+#include "GL.hpp"
+
+#include <cstdint>
+
+struct DrawPasses {
+	DrawPasses();
+	~DrawPasses();
+
+	DrawPasses(DrawPasses const &) = delete;
+	DrawPasses &operator=(DrawPasses const &) = delete;
+
+	bool depth_prepass = true;
+	bool sort_front_to_back = true;
+
+	enum Pass : uint32_t {
+		Depth = 0, //depth pre-pass
+		Opaque = 1, //color pass for opaque drawables
+		Transparent = 2, //back-to-front pass for blended drawables
+		PassCount
+	};
+
+	struct Stats {
+		//GPU time of each pass (milliseconds), from the most recent frame whose timer results are in:
+		double gpu_ms[PassCount] = { 0.0, 0.0, 0.0 };
+		uint32_t frames_behind = 0; //how many draws ago that frame was
+		//drawables sent through each pass by the last draw:
+		uint32_t drawables[PassCount] = { 0, 0, 0 };
+	} stats;
+
+	//called by Scene::draw around each pass:
+	// (only one pass may be timed at once, and passes must not nest other GL_TIME_ELAPSED queries)
+	void begin(Pass pass);
+	void end(Pass pass);
+	//called by Scene::draw after the last pass; collects any finished timer results:
+	void finish();
+
+private:
+	//each draw uses one slot of queries; slots are re-used once their results have been read:
+	enum : uint32_t { Slots = 4 };
+	struct Slot {
+		GLuint queries[PassCount] = { 0, 0, 0 };
+		bool used[PassCount] = { false, false, false }; //was the pass timed in this slot's draw?
+		bool pending = false; //waiting on results?
+		uint32_t serial = 0; //which draw used this slot
+	} slots[Slots];
+	uint32_t serial = 0; //draws so far
+	uint32_t reported = 0; //serial + 1 of the draw 'stats' came from
+	bool drawing = false; //between first begin() and finish()?
+	Slot *current = nullptr; //slot being filled by the current draw (nullptr if it is still pending)
+	void collect(); //read back any finished slots
+};
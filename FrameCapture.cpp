@@ -0,0 +1,344 @@
+#include "FrameCapture.hpp"
+
+#include "load_save_png.hpp"
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture(uint32_t slot_count, uint32_t worker_count, uint32_t max_queue) : max_jobs(max_queue) {
+	slots.resize(slot_count);
+	for (auto &slot : slots) {
+		glGenBuffers(1, &slot.pbo);
+	}
+	GL_ERRORS();
+
+	if (worker_count == 0) {
+		//leave a core for the game itself:
+		uint32_t cores = std::thread::hardware_concurrency();
+		worker_count = std::max(1u, std::min(4u, (cores > 1 ? cores - 1 : 1u)));
+	}
+	for (uint32_t w = 0; w < worker_count; ++w) {
+		workers.emplace_back(&FrameCapture::worker_main, this);
+	}
+}
+
+FrameCapture::~FrameCapture() {
+	if (recording) stop_recording();
+
+	//finish outstanding readbacks:
+	poll(true);
+
+	//let the workers finish the queue and exit:
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	for (auto &slot : slots) {
+		glDeleteBuffers(1, &slot.pbo);
+		slot.pbo = 0;
+	}
+}
+
+bool FrameCapture::capture(glm::uvec2 const &size, std::string const &filename) {
+	return start_readback(size, KindPNG, filename, false);
+}
+
+bool FrameCapture::start_readback(glm::uvec2 const &size, Kind kind, std::string const &filename, bool quiet) {
+	//find a free slot:
+	Slot *slot = nullptr;
+	uint32_t in_flight = 0;
+	for (auto &s : slots) {
+		if (s.fence == 0) {
+			if (!slot) slot = &s;
+		} else {
+			in_flight += 1;
+		}
+	}
+
+	{ //check for room (backpressure happens here, before doing any readback work):
+		std::unique_lock< std::mutex > lock(mutex);
+		if (!slot) {
+			stats.dropped_busy += 1;
+			return false;
+		}
+		if (jobs.size() + in_flight >= max_jobs) {
+			stats.dropped_queue += 1;
+			return false;
+		}
+		stats.captured += 1;
+	}
+
+	slot->order = next_order++;
+	slot->size = size;
+	slot->kind = kind;
+	slot->quiet = quiet;
+	slot->filename = filename;
+
+	//start copying the framebuffer into the pixel buffer (returns right away):
+	GLsizeiptr bytes = GLsizeiptr(size.x) * GLsizeiptr(size.y) * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, GLsizei(size.x), GLsizei(size.y), GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	//...and note when it is done:
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	GL_ERRORS();
+
+	return true;
+}
+
+void FrameCapture::poll(bool wait) {
+	//visit in-flight slots in capture order (so video frames stay in order):
+	std::vector< Slot * > pending;
+	for (auto &slot : slots) {
+		if (slot.fence != 0) pending.emplace_back(&slot);
+	}
+	std::sort(pending.begin(), pending.end(), [](Slot const *a, Slot const *b){ return a->order < b->order; });
+
+	for (Slot *slot_ptr : pending) {
+		Slot &slot = *slot_ptr;
+
+		GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, (wait ? 1000000000ull : 0));
+		if (result == GL_TIMEOUT_EXPIRED) break; //not done yet (and later readbacks won't be either)
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		if (result == GL_WAIT_FAILED) {
+			std::cerr << "WARNING: failed waiting for frame capture readback." << std::endl;
+			std::unique_lock< std::mutex > lock(mutex);
+			stats.failed += 1;
+			continue;
+		}
+
+		//grab a recycled pixel buffer, if there is one:
+		Job job;
+		job.size = slot.size;
+		job.kind = slot.kind;
+		job.quiet = slot.quiet;
+		job.filename = slot.filename;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			if (!free_pixels.empty()) {
+				job.pixels = std::move(free_pixels.back());
+				free_pixels.pop_back();
+			}
+		}
+		job.pixels.resize(size_t(slot.size.x) * size_t(slot.size.y));
+
+		//copy out of the pixel buffer:
+		GLsizeiptr bytes = GLsizeiptr(job.pixels.size() * sizeof(glm::u8vec4));
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		void const *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+		if (src) {
+			std::memcpy(job.pixels.data(), src, size_t(bytes));
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		GL_ERRORS();
+
+		if (!src) {
+			std::cerr << "WARNING: failed to map frame capture buffer." << std::endl;
+			std::unique_lock< std::mutex > lock(mutex);
+			stats.failed += 1;
+			free_pixels.emplace_back(std::move(job.pixels));
+			continue;
+		}
+
+		//hand off to workers:
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			if (job.kind == KindY4M) job.sequence = y4m_next_enqueue++;
+			jobs.emplace_back(std::move(job));
+			stats.max_queue = std::max(stats.max_queue, uint32_t(jobs.size()));
+		}
+		cv.notify_one();
+	}
+}
+
+void FrameCapture::start_recording(std::string const &path, Format format, uint32_t every, uint32_t frame_rate) {
+	if (recording) stop_recording();
+
+	record_path = path;
+	record_format = format;
+	record_every = std::max(1u, every);
+	record_frame_rate = std::max(1u, frame_rate);
+	record_frame_index = 0;
+
+	if (format == Y4M) {
+		std::unique_lock< std::mutex > lock(y4m_mutex);
+		y4m_stream.open(path, std::ios::binary);
+		if (!y4m_stream) {
+			std::cerr << "WARNING: failed to open '" << path << "' for recording." << std::endl;
+			return;
+		}
+		y4m_size = glm::uvec2(0);
+		y4m_next_write = 0;
+		y4m_ready.clear();
+		std::unique_lock< std::mutex > lock2(mutex);
+		y4m_next_enqueue = 0;
+	}
+
+	recording = true;
+	std::cout << "Recording every " << (record_every == 1 ? std::string("") : std::to_string(record_every) + "th ") << "frame to '" << path << "'"
+		<< (format == Y4M ? " (y4m)" : " (png sequence)") << "." << std::endl;
+}
+
+void FrameCapture::record_frame(glm::uvec2 const &size) {
+	if (!recording) return;
+	uint64_t index = record_frame_index++;
+	if (index % record_every != 0) return;
+
+	std::string filename;
+	if (record_format == PNGSequence) {
+		char number[32];
+		std::snprintf(number, sizeof(number), "-%06llu.png", (unsigned long long)(index / record_every));
+		filename = record_path + number;
+	}
+	start_readback(size, (record_format == Y4M ? KindY4M : KindPNG), filename, true);
+}
+
+void FrameCapture::stop_recording() {
+	if (!recording) return;
+
+	//readbacks and encoding for record_format are done before recording is cleared:
+	poll(true);
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		idle_cv.wait(lock, [this](){ return jobs.empty() && busy_workers == 0; });
+	}
+	recording = false;
+
+	if (record_format == Y4M) {
+		std::unique_lock< std::mutex > lock(y4m_mutex);
+		y4m_stream.close();
+		y4m_ready.clear();
+	}
+
+	Stats s = get_stats();
+	std::cout << "Recording stopped: " << s.encoded << " frames written; dropped " << s.dropped_busy << " (readback busy) + "
+		<< s.dropped_queue << " (encoder queue full); " << s.failed << " failed; max queue " << s.max_queue << "; "
+		<< (s.encoded ? 1000.0 * s.encode_seconds / double(s.encoded) : 0.0) << " ms encode time per frame." << std::endl;
+}
+
+FrameCapture::Stats FrameCapture::get_stats() {
+	std::unique_lock< std::mutex > lock(mutex);
+	return stats;
+}
+
+void FrameCapture::worker_main() {
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		cv.wait(lock, [this](){ return quit || !jobs.empty(); });
+		if (jobs.empty()) break; //(only happens when quitting)
+
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+		busy_workers += 1;
+
+		//encode without holding the lock:
+		lock.unlock();
+		auto before = std::chrono::steady_clock::now();
+		bool ok = true;
+		if (job.kind == KindPNG) {
+			for (auto &px : job.pixels) {
+				px.a = 0xff;
+			}
+			try {
+				//recorded frames are already encoded in parallel (one per worker), so only use extra threads for screenshots:
+				PNGSaveOptions options = PNGSaveOptions::fast();
+				options.threads = (job.quiet ? 1 : 0);
+				save_png(job.filename, job.size, job.pixels.data(), LowerLeftOrigin, options);
+				if (!job.quiet) std::cout << "Saved screenshot to '" << job.filename << "'." << std::endl;
+			} catch (std::exception &e) {
+				std::cerr << "WARNING: failed to save '" << job.filename << "': " << e.what() << std::endl;
+				ok = false;
+			}
+		} else {
+			ok = encode_y4m(job);
+		}
+		double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		lock.lock();
+
+		if (ok) stats.encoded += 1;
+		else stats.failed += 1;
+		stats.encode_seconds += seconds;
+		free_pixels.emplace_back(std::move(job.pixels));
+		busy_workers -= 1;
+		idle_cv.notify_all();
+	}
+}
+
+bool FrameCapture::encode_y4m(Job &job) {
+	//4:2:0 needs even dimensions, so drop the last row/column if needed:
+	glm::uvec2 size = glm::uvec2(job.size.x & ~1u, job.size.y & ~1u);
+
+	{ //the first frame decides the stream size:
+		std::unique_lock< std::mutex > lock(y4m_mutex);
+		if (y4m_size == glm::uvec2(0) && size.x > 0 && size.y > 0) {
+			y4m_size = size;
+			//(XCOLORRANGE=FULL because players otherwise assume limited-range 16-235 luma)
+			y4m_stream << "YUV4MPEG2 W" << size.x << " H" << size.y << " F" << record_frame_rate << ":1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+		}
+	}
+
+	std::vector< uint8_t > yuv;
+	bool skipped = (size != y4m_size);
+	if (skipped) {
+		//(window was resized; frames can't change size in a y4m stream, so skip this one)
+		std::cerr << "WARNING: skipping " << job.size.x << "x" << job.size.y << " frame in " << y4m_size.x << "x" << y4m_size.y << " recording." << std::endl;
+	} else {
+		//convert to full-range BT.601 YCbCr with 2x2-averaged chroma, flipping so the first row is the top:
+		uint32_t w = size.x, h = size.y;
+		yuv.resize(size_t(w) * h * 3 / 2);
+		uint8_t *Y = yuv.data();
+		uint8_t *U = Y + size_t(w) * h;
+		uint8_t *V = U + size_t(w / 2) * (h / 2);
+		auto px = [&](uint32_t x, uint32_t y) -> glm::u8vec4 const & {
+			return job.pixels[size_t(job.size.y - 1 - y) * job.size.x + x];
+		};
+		for (uint32_t y = 0; y < h; ++y) {
+			for (uint32_t x = 0; x < w; ++x) {
+				glm::u8vec4 const &c = px(x, y);
+				Y[size_t(y) * w + x] = uint8_t(std::min(255.0f, 0.299f * c.r + 0.587f * c.g + 0.114f * c.b + 0.5f));
+			}
+		}
+		for (uint32_t y = 0; y < h / 2; ++y) {
+			for (uint32_t x = 0; x < w / 2; ++x) {
+				glm::u8vec4 const &a = px(2*x, 2*y), &b = px(2*x+1, 2*y), &c = px(2*x, 2*y+1), &d = px(2*x+1, 2*y+1);
+				float r = 0.25f * (float(a.r) + float(b.r) + float(c.r) + float(d.r));
+				float g = 0.25f * (float(a.g) + float(b.g) + float(c.g) + float(d.g));
+				float bl = 0.25f * (float(a.b) + float(b.b) + float(c.b) + float(d.b));
+				float cb = 128.0f - 0.168736f * r - 0.331264f * g + 0.5f * bl;
+				float cr = 128.0f + 0.5f * r - 0.418688f * g - 0.081312f * bl;
+				U[size_t(y) * (w / 2) + x] = uint8_t(std::max(0.0f, std::min(255.0f, cb + 0.5f)));
+				V[size_t(y) * (w / 2) + x] = uint8_t(std::max(0.0f, std::min(255.0f, cr + 0.5f)));
+			}
+		}
+	}
+
+	//write this frame (and any later ones that were waiting on it) in sequence order:
+	std::unique_lock< std::mutex > lock(y4m_mutex);
+	y4m_ready[job.sequence] = std::move(yuv);
+	while (!y4m_ready.empty() && y4m_ready.begin()->first == y4m_next_write) {
+		std::vector< uint8_t > const &frame = y4m_ready.begin()->second;
+		if (!frame.empty() && y4m_stream) {
+			y4m_stream << "FRAME\n";
+			y4m_stream.write(reinterpret_cast< char const * >(frame.data()), std::streamsize(frame.size()));
+		}
+		y4m_ready.erase(y4m_ready.begin());
+		y4m_next_write += 1;
+	}
+	return !skipped;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+ * FrameCapture saves screenshots and recordings without stalling the game loop:
+ *  - capture() starts an asynchronous read of the back buffer into a pixel buffer object
+ *  - poll() (called once a frame) maps readbacks that have finished (usually a frame or two later)
+ *  - a pool of worker threads does the (slow) encoding
+ *
+ * In record mode, every Nth frame is captured to numbered PNGs or a raw .y4m video stream.
+ * The encoder queue is bounded: if encoding can't keep up, frames are dropped (and counted in Stats)
+ * rather than making the game loop wait.
+ *
+ */
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FrameCapture {
+	//'slots' is the number of readbacks that can be in flight at once;
+	//'workers' is the number of encoder threads (0 == pick based on core count);
+	//'max_queue' is the most frames that may wait for an encoder before new frames are dropped:
+	FrameCapture(uint32_t slots = 4, uint32_t workers = 0, uint32_t max_queue = 8);
+	//finishes any pending captures before returning (call while the GL context still exists):
+	~FrameCapture();
+
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	//start reading back the lower-left 'size' pixels of the current (back) buffer -- call after drawing, before swapping:
+	// once read, pixels are saved to 'filename' as a PNG.
+	// returns false (and skips the capture) if all slots are busy or the encoder queue is full.
+	bool capture(glm::uvec2 const &size, std::string const &filename);
+
+	//hand finished readbacks to the encoder threads (call once per frame):
+	// if 'wait' is true, waits for every in-flight readback to finish.
+	void poll(bool wait = false);
+
+	//---- record mode ----
+	enum Format {
+		PNGSequence, //path-000000.png, path-000001.png, ...
+		Y4M, //one uncompressed YUV 4:2:0 video file (play or convert with, e.g., ffmpeg or mpv)
+	};
+	//start recording every 'every'-th frame (frame_rate is written into the .y4m header):
+	void start_recording(std::string const &path, Format format, uint32_t every = 1, uint32_t frame_rate = 60);
+	//call once per frame (after drawing, before swapping) while recording:
+	void record_frame(glm::uvec2 const &size);
+	//stop recording, waiting for all captured frames to be written:
+	void stop_recording();
+	bool recording = false;
+
+	struct Stats {
+		uint64_t captured = 0; //readbacks started
+		uint64_t encoded = 0; //frames written
+		uint64_t dropped_busy = 0; //frames skipped because every readback slot was in flight
+		uint64_t dropped_queue = 0; //frames skipped because the encoder queue was full (backpressure)
+		uint64_t failed = 0; //frames lost to readback or encoding errors
+		uint32_t max_queue = 0; //deepest the encoder queue has been
+		double encode_seconds = 0.0; //total time spent encoding (across all workers)
+	};
+	Stats get_stats();
+
+	//---- internals ----
+	enum Kind {
+		KindPNG,
+		KindY4M,
+	};
+
+	struct Slot {
+		GLuint pbo = 0;
+		GLsync fence = 0; //non-zero while a readback is in flight
+		uint64_t order = 0; //capture order (readbacks are handed to encoders in this order)
+		glm::uvec2 size = glm::uvec2(0);
+		Kind kind = KindPNG;
+		bool quiet = false; //don't announce when saved (recorded frames)
+		std::string filename;
+	};
+	std::vector< Slot > slots;
+	uint64_t next_order = 0;
+	bool start_readback(glm::uvec2 const &size, Kind kind, std::string const &filename, bool quiet);
+
+	struct Job {
+		glm::uvec2 size = glm::uvec2(0);
+		Kind kind = KindPNG;
+		bool quiet = false;
+		std::string filename; //(for KindPNG)
+		uint64_t sequence = 0; //(for KindY4M) position in the video stream
+		std::vector< glm::u8vec4 > pixels;
+	};
+
+	//record mode state:
+	std::string record_path;
+	Format record_format = PNGSequence;
+	uint32_t record_every = 1;
+	uint32_t record_frame_rate = 60;
+	uint64_t record_frame_index = 0; //frames seen since start_recording()
+
+	//shared with the encoder threads:
+	std::mutex mutex;
+	std::condition_variable cv; //signalled when jobs are added (or on quit)
+	std::condition_variable idle_cv; //signalled when a job finishes
+	std::deque< Job > jobs; //waiting to be encoded
+	uint32_t max_jobs = 8;
+	uint32_t busy_workers = 0;
+	std::vector< std::vector< glm::u8vec4 > > free_pixels; //recycled pixel buffers
+	Stats stats;
+	bool quit = false;
+
+	//.y4m output (frames are converted in parallel but must be written in order):
+	std::mutex y4m_mutex;
+	std::ofstream y4m_stream;
+	glm::uvec2 y4m_size = glm::uvec2(0); //size of frames in the stream (0 until the first frame)
+	uint64_t y4m_next_enqueue = 0; //sequence number for the next Y4M job
+	uint64_t y4m_next_write = 0; //sequence number to write next
+	std::map< uint64_t, std::vector< uint8_t > > y4m_ready; //converted frames waiting for their turn (empty == skipped)
+
+	std::vector< std::thread > workers;
+	void worker_main();
+	bool encode_y4m(Job &job); //returns false if frame was skipped
+};
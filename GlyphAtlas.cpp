@@ -0,0 +1,163 @@
+#include "GlyphAtlas.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+//empty pixels between glyphs, so linear filtering doesn't pick up neighbors:
+constexpr uint32_t const PADDING = 1;
+
+//distance (in pixels) covered by the SDF renderer on each side of the outline (FreeType's default 'spread' property):
+constexpr uint32_t const SDF_SPREAD = 8;
+
+GlyphAtlas::GlyphAtlas(FT_Face face_, uint32_t size_, Mode mode_) : size(size_), mode(mode_), face(face_) {
+	if (mode == SDF && !GLYPH_ATLAS_HAS_SDF) {
+		throw std::runtime_error("GlyphAtlas: this FreeType (" + std::to_string(FREETYPE_MAJOR) + "." + std::to_string(FREETYPE_MINOR) + ") doesn't have an SDF renderer.");
+	}
+
+	glGenTextures(1, &tex);
+	reset(size);
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GL_ERRORS();
+}
+
+GlyphAtlas::~GlyphAtlas() {
+	glDeleteTextures(1, &tex);
+	tex = 0;
+}
+
+void GlyphAtlas::reset(uint32_t new_size) {
+	glyphs.clear();
+	evictions += uint32_t(shelves.size());
+	shelves.clear();
+	next_shelf_y = 0;
+	size = new_size;
+
+	std::vector< uint8_t > zeros(size * size, 0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GLsizei(size), GLsizei(size), 0, GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GL_ERRORS();
+}
+
+GlyphAtlas::Glyph const *GlyphAtlas::lookup(uint32_t glyph_index) {
+	{ //already in the atlas?
+		auto f = glyphs.find(glyph_index);
+		if (f != glyphs.end()) {
+			shelves[f->second.shelf].last_used = frame;
+			return &f->second;
+		}
+	}
+
+	//rasterize:
+	if (FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT)) return nullptr;
+	#if GLYPH_ATLAS_HAS_SDF
+	FT_Render_Mode render_mode = (mode == SDF ? FT_RENDER_MODE_SDF : FT_RENDER_MODE_NORMAL);
+	#else
+	FT_Render_Mode render_mode = FT_RENDER_MODE_NORMAL;
+	#endif
+	if (FT_Render_Glyph(face->glyph, render_mode)) return nullptr;
+
+	FT_Bitmap const &bm = face->glyph->bitmap;
+	if (bm.pixel_mode != FT_PIXEL_MODE_GRAY) {
+		std::cerr << "WARNING: glyph " << glyph_index << " didn't render as 8-bit gray; skipping it." << std::endl;
+		return nullptr;
+	}
+	if (bm.width + PADDING > size || bm.rows + PADDING > size) {
+		std::cerr << "WARNING: glyph " << glyph_index << " (" << bm.width << "x" << bm.rows << ") doesn't fit in a " << size << "x" << size << " atlas; skipping it." << std::endl;
+		return nullptr;
+	}
+
+	Glyph glyph;
+	glyph.size = glm::uvec2(bm.width, bm.rows);
+	glyph.bearing_y = face->glyph->metrics.horiBearingY / 64.0f;
+	if (mode == SDF && bm.width > 0 && bm.rows > 0) glyph.padding = float(SDF_SPREAD);
+
+	//pack into a shelf and upload:
+	glyph.shelf = allocate(bm.width + PADDING, bm.rows + PADDING);
+	Shelf &shelf = shelves[glyph.shelf];
+	glm::uvec2 at = glm::uvec2(shelf.x, shelf.y);
+	shelf.x += bm.width + PADDING;
+	shelf.last_used = frame;
+
+	if (bm.width > 0 && bm.rows > 0) {
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, std::abs(bm.pitch));
+		glTexSubImage2D(GL_TEXTURE_2D, 0, GLint(at.x), GLint(at.y), GLsizei(bm.width), GLsizei(bm.rows), GL_RED, GL_UNSIGNED_BYTE, bm.buffer);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		GL_ERRORS();
+	}
+
+	glyph.uv_min = glm::vec2(at) / float(size);
+	glyph.uv_max = glm::vec2(at + glyph.size) / float(size);
+
+	return &(glyphs[glyph_index] = glyph);
+}
+
+uint32_t GlyphAtlas::allocate(uint32_t w, uint32_t h) {
+	//existing shelf that is tall enough (but not too much taller) with room left:
+	uint32_t best = uint32_t(-1);
+	for (uint32_t s = 0; s < shelves.size(); ++s) {
+		Shelf const &shelf = shelves[s];
+		if (shelf.height < h || shelf.height > h + h / 4 + 8) continue;
+		if (shelf.x + w > size) continue;
+		if (best == uint32_t(-1) || shelf.height < shelves[best].height) best = s;
+	}
+	if (best != uint32_t(-1)) return best;
+
+	//open a new shelf (heights are rounded up so shelves get reused by similar glyphs):
+	uint32_t height = std::min(size, (h + 7) / 8 * 8);
+	if (next_shelf_y + height <= size) {
+		shelves.emplace_back();
+		shelves.back().y = next_shelf_y;
+		shelves.back().height = height;
+		next_shelf_y += height;
+		return uint32_t(shelves.size() - 1);
+	}
+
+	//atlas is full, so clear out the least-recently-used shelf that is tall enough:
+	uint32_t lru = uint32_t(-1);
+	for (uint32_t s = 0; s < shelves.size(); ++s) {
+		if (shelves[s].height < h) continue;
+		if (lru == uint32_t(-1) || shelves[s].last_used < shelves[lru].last_used) lru = s;
+	}
+
+	if (lru == uint32_t(-1)) {
+		//no shelf is tall enough, so start over with an empty atlas:
+		reset(size);
+		return allocate(w, h);
+	}
+
+	for (auto gi = glyphs.begin(); gi != glyphs.end(); /* later */) {
+		if (gi->second.shelf == lru) gi = glyphs.erase(gi);
+		else ++gi;
+	}
+	shelves[lru].x = 0;
+	evictions += 1;
+
+	//clear the old glyphs' pixels so they don't bleed into the padding around new ones:
+	std::vector< uint8_t > zeros(size * shelves[lru].height, 0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(shelves[lru].y), GLsizei(size), GLsizei(shelves[lru].height), GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return lru;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * GlyphAtlas keeps rasterized glyphs from a FreeType face packed into a
+ * single-channel (GL_R8) texture, so each glyph is only rendered once.
+ *
+ * Glyphs are packed into horizontal shelves; when the texture is full, the
+ * least-recently-used shelf is cleared out and reused.
+ *
+ */
+
+#include "GL.hpp"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+//FreeType's SDF renderer showed up in version 2.11:
+#if FREETYPE_MAJOR > 2 || (FREETYPE_MAJOR == 2 && FREETYPE_MINOR >= 11)
+#define GLYPH_ATLAS_HAS_SDF 1
+#else
+#define GLYPH_ATLAS_HAS_SDF 0
+#endif
+
+struct GlyphAtlas {
+	//what is stored in the atlas texture:
+	enum Mode {
+		Coverage, //anti-aliased coverage (0 == outside glyph, 1 == inside); draw at the face's size
+		SDF, //signed distance field (0.5 == edge, larger == inside); draw at any size
+	};
+
+	//NOTE: face's size should be set before creating the atlas (and not changed after):
+	// (SDF mode throws if this FreeType doesn't have the SDF renderer)
+	GlyphAtlas(FT_Face face, uint32_t size = 1024, Mode mode = Coverage);
+	~GlyphAtlas();
+
+	GlyphAtlas(GlyphAtlas const &) = delete;
+	GlyphAtlas &operator=(GlyphAtlas const &) = delete;
+
+	struct Glyph {
+		glm::vec2 uv_min = glm::vec2(0.0f); //texture coordinates of upper left of bitmap
+		glm::vec2 uv_max = glm::vec2(0.0f); //texture coordinates of lower right of bitmap
+		glm::uvec2 size = glm::uvec2(0); //bitmap size, in pixels (may be zero for, e.g., spaces)
+		float bearing_y = 0.0f; //glyph metrics' horiBearingY, in pixels
+		float padding = 0.0f; //extra pixels around the outline on each side of the bitmap (SDF mode only)
+		uint32_t shelf = 0; //(internal) shelf glyph is packed into
+	};
+
+	//Look up a glyph by index, rasterizing and packing it if needed:
+	// returns nullptr if FreeType can't render the glyph
+	// (the pointer is good until the next call to lookup())
+	Glyph const *lookup(uint32_t glyph_index);
+
+	//Call once per frame to advance the clock used for least-recently-used eviction:
+	void next_frame() { frame += 1; }
+
+	//Throw out all glyphs and reallocate the texture as new_size x new_size (e.g., to make room for more glyphs):
+	// (counts as evicting every shelf)
+	void reset(uint32_t new_size);
+
+	//atlas texture; bind this when drawing glyphs:
+	GLuint tex = 0;
+	uint32_t size = 0;
+	Mode mode = Coverage;
+
+	//---- internals ----
+	FT_Face face;
+
+	std::unordered_map< uint32_t, Glyph > glyphs;
+
+	struct Shelf {
+		uint32_t y = 0; //top of shelf in texture
+		uint32_t height = 0;
+		uint32_t x = 0; //next free x position
+		uint32_t last_used = 0; //frame shelf was last drawn from
+	};
+	std::vector< Shelf > shelves;
+	uint32_t next_shelf_y = 0; //texture rows below here haven't been given to a shelf yet
+
+	uint32_t frame = 0;
+	uint32_t evictions = 0; //number of shelves that have been cleared (so far)
+
+	//find space for a w x h bitmap; returns shelf index (evicting if needed):
+	uint32_t allocate(uint32_t w, uint32_t h);
+};
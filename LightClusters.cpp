@@ -0,0 +1,306 @@
+#include "LightClusters.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define LIGHT_CLUSTERS_USE_SSE
+#endif
+
+LightClusters::LightClusters(glm::uvec3 grid_, float far_depth_, uint32_t threads) : grid(grid_), far_depth(far_depth_) {
+	assert(grid.x > 0 && grid.y > 0 && grid.z > 1);
+	slices.resize(grid.z);
+
+	if (threads == 0) {
+		threads = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+	}
+	//(the thread calling update() does a share of the work, too)
+	for (uint32_t t = 1; t < threads; ++t) {
+		workers.emplace_back(&LightClusters::worker_main, this);
+	}
+}
+
+LightClusters::~LightClusters() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	start_cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	if (ranges_tex) glDeleteTextures(1, &ranges_tex);
+	if (indices_tex) glDeleteTextures(1, &indices_tex);
+	if (ranges_buffer) glDeleteBuffers(1, &ranges_buffer);
+	if (indices_buffer) glDeleteBuffers(1, &indices_buffer);
+}
+
+void LightClusters::run(uint32_t count, std::function< void(uint32_t) > const &fn) {
+	if (workers.empty()) {
+		for (uint32_t i = 0; i < count; ++i) fn(i);
+		return;
+	}
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		job = &fn;
+		job_count = count;
+		next_item = 0;
+		busy = uint32_t(workers.size());
+		generation += 1;
+	}
+	start_cv.notify_all();
+
+	for (uint32_t i = next_item++; i < count; i = next_item++) fn(i);
+
+	std::unique_lock< std::mutex > lock(mutex);
+	done_cv.wait(lock, [this](){ return busy == 0; });
+	job = nullptr;
+}
+
+void LightClusters::worker_main() {
+	uint32_t seen = 0;
+	while (true) {
+		std::function< void(uint32_t) > const *todo;
+		uint32_t count;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			start_cv.wait(lock, [&](){ return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+			todo = job;
+			count = job_count;
+		}
+
+		for (uint32_t i = next_item++; i < count; i = next_item++) (*todo)(i);
+
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			busy -= 1;
+			if (busy == 0) done_cv.notify_one();
+		}
+	}
+}
+
+void LightClusters::update(Scene::Camera const &camera, std::list< Scene::Light > const &lights) {
+	auto before = std::chrono::high_resolution_clock::now();
+
+	assert(camera.transform);
+	near_depth = camera.near;
+	glm::mat4x3 world_to_view = camera.transform->make_world_to_local();
+
+	//---- light bounds in view space ----
+	//(hemisphere and directional lights reach everywhere, so get a huge sphere)
+	constexpr float const Everywhere = 1.0e18f;
+	bounds.clear();
+	float max_depth = far_depth; //deepest point any (local) light reaches
+	for (auto const &light : lights) {
+		if (bounds.size() == Scene::MaxLights) break; //(Scene::draw warns about this)
+		assert(light.transform);
+		glm::mat4x3 light_to_view = world_to_view * glm::mat4(light.transform->make_local_to_world());
+
+		LightBounds b;
+		b.position = light_to_view[3];
+		b.direction = glm::normalize(-light_to_view[2]);
+		b.cos_cutoff = -2.0f;
+		b.sin_cutoff = 0.0f;
+		if (light.type == Scene::Light::Point || light.type == Scene::Light::Spot) {
+			b.radius = light.distance;
+			max_depth = std::max(max_depth, -b.position.z + b.radius);
+			if (light.type == Scene::Light::Spot) {
+				b.cos_cutoff = std::cos(0.5f * light.spot_fov);
+				b.sin_cutoff = std::sin(0.5f * light.spot_fov);
+			}
+		} else {
+			b.position = glm::vec3(0.0f);
+			b.radius = Everywhere;
+		}
+		bounds.emplace_back(b);
+	}
+
+	//---- cluster geometry ----
+	//slice k covers depths [near * (far/near)^(k/(Z-1)), near * (far/near)^((k+1)/(Z-1))]:
+	float const log_ratio = std::log(far_depth / near_depth) / float(grid.z - 1);
+	auto slice_depth = [&](uint32_t k) -> float {
+		if (k + 1 > grid.z) return std::max(max_depth, 2.0f * far_depth); //(end of the last slice)
+		return near_depth * std::exp(log_ratio * float(k));
+	};
+	float const tan_y = std::tan(0.5f * camera.fovy);
+	float const tan_x = tan_y * camera.aspect;
+
+	//---- assign lights to clusters, one depth slice at a time ----
+	uint32_t const tiles = grid.x * grid.y;
+	run(grid.z, [&](uint32_t k) {
+		Slice &slice = slices[k];
+		float const d0 = slice_depth(k);
+		float const d1 = slice_depth(k + 1);
+
+		//gather lights that overlap this slice's depth range:
+		slice.lights.clear();
+		slice.x.clear(); slice.y.clear(); slice.z.clear(); slice.radius.clear();
+		slice.dx.clear(); slice.dy.clear(); slice.dz.clear(); slice.cos_cutoff.clear(); slice.sin_cutoff.clear();
+		for (uint32_t l = 0; l < bounds.size(); ++l) {
+			LightBounds const &b = bounds[l];
+			float depth = -b.position.z;
+			if (depth + b.radius < d0 || depth - b.radius > d1) continue;
+			slice.lights.emplace_back(uint16_t(l));
+			slice.x.emplace_back(b.position.x);
+			slice.y.emplace_back(b.position.y);
+			slice.z.emplace_back(b.position.z);
+			slice.radius.emplace_back(b.radius);
+			slice.dx.emplace_back(b.direction.x);
+			slice.dy.emplace_back(b.direction.y);
+			slice.dz.emplace_back(b.direction.z);
+			slice.cos_cutoff.emplace_back(b.cos_cutoff);
+			slice.sin_cutoff.emplace_back(b.sin_cutoff);
+		}
+		uint32_t const count = uint32_t(slice.lights.size());
+		//pad to a multiple of four with lights that can't reach anything:
+		while (slice.x.size() % 4 != 0) {
+			slice.x.emplace_back(Everywhere); slice.y.emplace_back(Everywhere); slice.z.emplace_back(Everywhere);
+			slice.radius.emplace_back(0.0f);
+			slice.dx.emplace_back(0.0f); slice.dy.emplace_back(0.0f); slice.dz.emplace_back(-1.0f);
+			slice.cos_cutoff.emplace_back(-2.0f); slice.sin_cutoff.emplace_back(0.0f);
+		}
+
+		slice.ranges.assign(tiles, glm::uvec2(0));
+		slice.indices.clear();
+		if (count == 0) return;
+
+		for (uint32_t j = 0; j < grid.y; ++j) {
+			float const y0 = (-1.0f + 2.0f * float(j) / float(grid.y)) * tan_y;
+			float const y1 = (-1.0f + 2.0f * float(j + 1) / float(grid.y)) * tan_y;
+			for (uint32_t i = 0; i < grid.x; ++i) {
+				float const x0 = (-1.0f + 2.0f * float(i) / float(grid.x)) * tan_x;
+				float const x1 = (-1.0f + 2.0f * float(i + 1) / float(grid.x)) * tan_x;
+
+				//view-space bounding box of the cluster:
+				glm::vec3 box_min = glm::vec3(std::min(x0 * d0, x0 * d1), std::min(y0 * d0, y0 * d1), -d1);
+				glm::vec3 box_max = glm::vec3(std::max(x1 * d0, x1 * d1), std::max(y1 * d0, y1 * d1), -d0);
+				//...and its bounding sphere (for cone tests):
+				glm::vec3 center = 0.5f * (box_min + box_max);
+				float radius = 0.5f * glm::length(box_max - box_min);
+
+				glm::uvec2 &range = slice.ranges[j * grid.x + i];
+				range.x = uint32_t(slice.indices.size());
+
+				for (uint32_t l = 0; l < count; l += 4) {
+					uint32_t hits;
+#ifdef LIGHT_CLUSTERS_USE_SSE
+					__m128 x = _mm_loadu_ps(&slice.x[l]);
+					__m128 y = _mm_loadu_ps(&slice.y[l]);
+					__m128 z = _mm_loadu_ps(&slice.z[l]);
+					__m128 r = _mm_loadu_ps(&slice.radius[l]);
+
+					//sphere vs. box: distance from sphere center to closest point in box:
+					__m128 ox = _mm_sub_ps(x, _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(box_max.x)), _mm_set1_ps(box_min.x)));
+					__m128 oy = _mm_sub_ps(y, _mm_max_ps(_mm_min_ps(y, _mm_set1_ps(box_max.y)), _mm_set1_ps(box_min.y)));
+					__m128 oz = _mm_sub_ps(z, _mm_max_ps(_mm_min_ps(z, _mm_set1_ps(box_max.z)), _mm_set1_ps(box_min.z)));
+					__m128 dis2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz));
+					__m128 in_sphere = _mm_cmple_ps(dis2, _mm_mul_ps(r, r));
+
+					//cone vs. cluster's bounding sphere:
+					__m128 vx = _mm_sub_ps(_mm_set1_ps(center.x), x);
+					__m128 vy = _mm_sub_ps(_mm_set1_ps(center.y), y);
+					__m128 vz = _mm_sub_ps(_mm_set1_ps(center.z), z);
+					__m128 v2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+					__m128 along = _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(vx, _mm_loadu_ps(&slice.dx[l])),
+						_mm_mul_ps(vy, _mm_loadu_ps(&slice.dy[l]))),
+						_mm_mul_ps(vz, _mm_loadu_ps(&slice.dz[l])));
+					__m128 across = _mm_sqrt_ps(_mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(v2, _mm_mul_ps(along, along))));
+					__m128 cos_cutoff = _mm_loadu_ps(&slice.cos_cutoff[l]);
+					__m128 closest = _mm_sub_ps(_mm_mul_ps(cos_cutoff, across), _mm_mul_ps(_mm_loadu_ps(&slice.sin_cutoff[l]), along));
+					__m128 sphere_radius = _mm_set1_ps(radius);
+					__m128 in_cone = _mm_and_ps(
+						_mm_cmple_ps(closest, sphere_radius),
+						_mm_cmpge_ps(along, _mm_sub_ps(_mm_setzero_ps(), sphere_radius)));
+					__m128 not_spot = _mm_cmplt_ps(cos_cutoff, _mm_set1_ps(-1.5f));
+
+					hits = uint32_t(_mm_movemask_ps(_mm_and_ps(in_sphere, _mm_or_ps(not_spot, in_cone))));
+#else
+					hits = 0;
+					for (uint32_t b = 0; b < 4; ++b) {
+						float x = slice.x[l+b], y = slice.y[l+b], z = slice.z[l+b], r = slice.radius[l+b];
+						float ox = x - std::max(std::min(x, box_max.x), box_min.x);
+						float oy = y - std::max(std::min(y, box_max.y), box_min.y);
+						float oz = z - std::max(std::min(z, box_max.z), box_min.z);
+						if (ox * ox + oy * oy + oz * oz > r * r) continue;
+						if (slice.cos_cutoff[l+b] >= -1.5f) {
+							float vx = center.x - x, vy = center.y - y, vz = center.z - z;
+							float along = vx * slice.dx[l+b] + vy * slice.dy[l+b] + vz * slice.dz[l+b];
+							float across = std::sqrt(std::max(0.0f, vx * vx + vy * vy + vz * vz - along * along));
+							float closest = slice.cos_cutoff[l+b] * across - slice.sin_cutoff[l+b] * along;
+							if (closest > radius || along < -radius) continue;
+						}
+						hits |= (1u << b);
+					}
+#endif
+					for (uint32_t b = 0; b < 4; ++b) {
+						if ((hits & (1u << b)) && l + b < count) {
+							slice.indices.emplace_back(slice.lights[l + b]);
+						}
+					}
+				}
+
+				range.y = uint32_t(slice.indices.size()) - range.x;
+			}
+		}
+	});
+
+	//---- merge slices into one list ----
+	ranges.resize(size_t(tiles) * grid.z);
+	indices.clear();
+	stats.max_cluster_lights = 0;
+	for (uint32_t k = 0; k < grid.z; ++k) {
+		Slice const &slice = slices[k];
+		uint32_t base = uint32_t(indices.size());
+		for (uint32_t t = 0; t < tiles; ++t) {
+			glm::uvec2 range = slice.ranges[t];
+			ranges[size_t(k) * tiles + t] = glm::uvec2(base + range.x, range.y);
+			stats.max_cluster_lights = std::max(stats.max_cluster_lights, range.y);
+		}
+		indices.insert(indices.end(), slice.indices.begin(), slice.indices.end());
+	}
+
+	stats.lights = uint32_t(bounds.size());
+	stats.indices = uint32_t(indices.size());
+	auto after = std::chrono::high_resolution_clock::now();
+	stats.update_seconds = std::chrono::duration< double >(after - before).count();
+}
+
+void LightClusters::upload() {
+	if (ranges_buffer == 0) {
+		glGenBuffers(1, &ranges_buffer);
+		glGenBuffers(1, &indices_buffer);
+		glGenTextures(1, &ranges_tex);
+		glGenTextures(1, &indices_tex);
+
+		glBindTexture(GL_TEXTURE_BUFFER, ranges_tex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, ranges_buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, indices_tex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, indices_buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	//(texture buffers can't be empty, so there's always at least one entry)
+	static glm::uvec2 const no_range = glm::uvec2(0);
+	static uint16_t const no_index = 0;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, ranges_buffer);
+	if (ranges.empty()) glBufferData(GL_TEXTURE_BUFFER, sizeof(no_range), &no_range, GL_STREAM_DRAW);
+	else glBufferData(GL_TEXTURE_BUFFER, ranges.size() * sizeof(ranges[0]), ranges.data(), GL_STREAM_DRAW);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, indices_buffer);
+	if (indices.empty()) glBufferData(GL_TEXTURE_BUFFER, sizeof(no_index), &no_index, GL_STREAM_DRAW);
+	else glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STREAM_DRAW);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	GL_ERRORS();
+}
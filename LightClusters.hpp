@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+ * LightClusters assigns a Scene's lights to a grid of view-frustum "clusters" so that
+ * shaders only loop over the lights that can reach each fragment (useful with hundreds of lights):
+ *  - the frustum is split into grid.x by grid.y screen tiles and grid.z depth slices
+ *    (slices are spaced exponentially between camera.near and 'far_depth'; the last slice runs to infinity)
+ *  - update() tests light spheres (and spot light cones) against every cluster on the CPU,
+ *    spreading depth slices over a few threads and testing four lights at a time with SSE (where available)
+ *  - upload() sends the result as two texture buffers:
+ *      ranges  (GL_RG32UI, one texel per cluster): first index, number of lights
+ *      indices (GL_R16UI): the lights of each cluster, one after another
+ *
+ * Use it by drawing with Scene::draw(camera, clusters); see LitColorTextureProgram for the shader side.
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct LightClusters {
+	//'threads' is the number of threads used by update() (0 == pick based on core count):
+	LightClusters(glm::uvec3 grid = glm::uvec3(16, 9, 24), float far_depth = 100.0f, uint32_t threads = 0);
+	~LightClusters();
+
+	LightClusters(LightClusters const &) = delete;
+	LightClusters &operator=(LightClusters const &) = delete;
+
+	glm::uvec3 const grid;
+	float const far_depth; //depth at which the last slice starts
+
+	//assign (the first Scene::MaxLights of) 'lights' to clusters of 'camera''s frustum:
+	// (does not use OpenGL, so it is fine to call without a context -- e.g., for benchmarking)
+	void update(Scene::Camera const &camera, std::list< Scene::Light > const &lights);
+
+	//send the cluster lists to the GPU (creates textures on first use):
+	void upload();
+
+	//cluster data from the most recent update:
+	float near_depth = 0.01f; //camera near plane
+	std::vector< glm::uvec2 > ranges; //per cluster (x fastest, then y, then z): first index, count
+	std::vector< uint16_t > indices;
+
+	//textures (GL_TEXTURE_BUFFER) holding 'ranges' and 'indices' after upload():
+	GLuint ranges_tex = 0;
+	GLuint indices_tex = 0;
+
+	struct Stats {
+		uint32_t lights = 0; //lights assigned
+		uint32_t indices = 0; //total light references in all clusters
+		uint32_t max_cluster_lights = 0; //lights in the fullest cluster
+		double update_seconds = 0.0; //time taken by the last update()
+	} stats;
+
+	//---- internals ----
+	GLuint ranges_buffer = 0;
+	GLuint indices_buffer = 0;
+
+	//view-space bounds of each light:
+	struct LightBounds {
+		glm::vec3 position; //bounding sphere center
+		float radius;
+		glm::vec3 direction; //spot cone axis
+		float cos_cutoff, sin_cutoff; //spot cone angle (cos_cutoff = -2 for lights that aren't spots)
+	};
+	std::vector< LightBounds > bounds;
+
+	//per-slice work, merged into 'ranges' and 'indices' once all slices are done:
+	struct Slice {
+		//lights that overlap the slice's depth range, as structure-of-arrays padded to a multiple of four:
+		std::vector< uint16_t > lights;
+		std::vector< float > x, y, z, radius, dx, dy, dz, cos_cutoff, sin_cutoff;
+		//results:
+		std::vector< glm::uvec2 > ranges; //per cluster in slice: first index (into slice's indices), count
+		std::vector< uint16_t > indices;
+	};
+	std::vector< Slice > slices;
+
+	//worker threads for update():
+	void run(uint32_t count, std::function< void(uint32_t) > const &fn); //calls fn(0) .. fn(count-1), spread over workers
+	void worker_main();
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable start_cv, done_cv;
+	std::function< void(uint32_t) > const *job = nullptr;
+	uint32_t job_count = 0;
+	std::atomic< uint32_t > next_item;
+	uint32_t generation = 0;
+	uint32_t busy = 0;
+	bool quit = false;
+};
@@ -0,0 +1,106 @@
+#include "LinesProgram.hpp"
+
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+static SubmittedProgram submitted_program("LinesProgram",
+	//vertex shader:
+	"#version 330\n"
+	"uniform mat4 OBJECT_TO_CLIP;\n"
+	"uniform vec2 VIEWPORT;\n"
+	"uniform float THICKNESS;\n"
+	"uniform bool BOXES;\n"
+	"in vec3 A;\n"
+	"in vec3 B;\n"
+	"in vec3 Box0;\n"
+	"in vec3 Box1;\n"
+	"in vec3 Box2;\n"
+	"in vec3 Box3;\n"
+	"in vec4 Color;\n"
+	"out vec4 color;\n"
+	//cube corners and edges (for boxes):
+	"const vec3 CORNERS[8] = vec3[8](\n"
+	"	vec3(-1.0,-1.0,-1.0), vec3( 1.0,-1.0,-1.0), vec3(-1.0, 1.0,-1.0), vec3( 1.0, 1.0,-1.0),\n"
+	"	vec3(-1.0,-1.0, 1.0), vec3( 1.0,-1.0, 1.0), vec3(-1.0, 1.0, 1.0), vec3( 1.0, 1.0, 1.0)\n"
+	");\n"
+	"const ivec2 EDGES[12] = ivec2[12](\n"
+	"	ivec2(0,1), ivec2(2,3), ivec2(4,5), ivec2(6,7),\n"
+	"	ivec2(0,2), ivec2(1,3), ivec2(4,6), ivec2(5,7),\n"
+	"	ivec2(0,4), ivec2(1,5), ivec2(2,6), ivec2(3,7)\n"
+	");\n"
+	//each segment is two triangles; which end (0 == a, 1 == b) and side (-1 or 1) of the segment each vertex is on:
+	"const int END[6] = int[6](0, 1, 0, 0, 1, 1);\n"
+	"const float SIDE[6] = float[6](-1.0, -1.0, 1.0, 1.0, -1.0, 1.0);\n"
+	"void main() {\n"
+	"	vec3 a = A;\n"
+	"	vec3 b = B;\n"
+	"	if (BOXES) {\n"
+	"		mat4x3 box = mat4x3(Box0, Box1, Box2, Box3);\n"
+	"		ivec2 edge = EDGES[gl_VertexID / 6];\n"
+	"		a = box * vec4(CORNERS[edge.x], 1.0);\n"
+	"		b = box * vec4(CORNERS[edge.y], 1.0);\n"
+	"	}\n"
+	"	int corner = gl_VertexID % 6;\n"
+	"	vec4 ca = OBJECT_TO_CLIP * vec4(a, 1.0);\n"
+	"	vec4 cb = OBJECT_TO_CLIP * vec4(b, 1.0);\n"
+	//clip against the near plane so the screen-space direction makes sense:
+	"	const float near_w = 1e-4;\n"
+	"	if (ca.w < near_w && cb.w < near_w) {\n"
+	"		gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n" //entirely behind the camera; clipped away
+	"		color = Color;\n"
+	"		return;\n"
+	"	}\n"
+	"	if (ca.w < near_w) ca = mix(ca, cb, (near_w - ca.w) / (cb.w - ca.w));\n"
+	"	if (cb.w < near_w) cb = mix(cb, ca, (near_w - cb.w) / (ca.w - cb.w));\n"
+	//expand to a quad THICKNESS pixels wide (with ends extended by half the thickness so corners join):
+	"	vec2 half_viewport = 0.5 * VIEWPORT;\n"
+	"	vec2 sa = ca.xy / ca.w * half_viewport;\n"
+	"	vec2 sb = cb.xy / cb.w * half_viewport;\n"
+	"	vec2 along = sb - sa;\n"
+	"	float len = length(along);\n"
+	"	along = (len > 1e-6 ? along / len : vec2(1.0, 0.0));\n"
+	"	vec2 across = vec2(-along.y, along.x);\n"
+	"	vec4 p = (END[corner] == 0 ? ca : cb);\n"
+	"	vec2 offset = 0.5 * THICKNESS * (SIDE[corner] * across + (END[corner] == 0 ? -along : along));\n"
+	"	p.xy += offset / half_viewport * p.w;\n"
+	"	gl_Position = p;\n"
+	"	color = Color;\n"
+	"}\n"
+,
+	//fragment shader:
+	"#version 330\n"
+	"in vec4 color;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragColor = color;\n"
+	"}\n"
+);
+
+Load< LinesProgram > lines_program(LoadTagEarly);
+
+LinesProgram::LinesProgram() {
+	//wait for the program submitted above to finish compiling (throws on errors):
+	program = submitted_program.finish();
+
+	//look up the locations of vertex attributes:
+	A_vec3 = glGetAttribLocation(program, "A");
+	B_vec3 = glGetAttribLocation(program, "B");
+	Box0_vec3 = glGetAttribLocation(program, "Box0");
+	Box1_vec3 = glGetAttribLocation(program, "Box1");
+	Box2_vec3 = glGetAttribLocation(program, "Box2");
+	Box3_vec3 = glGetAttribLocation(program, "Box3");
+	Color_vec4 = glGetAttribLocation(program, "Color");
+
+	//look up the locations of uniforms:
+	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
+	VIEWPORT_vec2 = glGetUniformLocation(program, "VIEWPORT");
+	THICKNESS_float = glGetUniformLocation(program, "THICKNESS");
+	BOXES_bool = glGetUniformLocation(program, "BOXES");
+
+	GL_ERRORS();
+}
+
+LinesProgram::~LinesProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+
+//Shader program that draws thick, colored line segments (or wireframe boxes) from per-instance data:
+// each instance is either a segment (A, B) or a box (the [-1,1]^3 cube transformed by mat4x3(Box0, Box1, Box2, Box3)),
+// and is expanded to screen-space quads of width THICKNESS pixels in the vertex shader.
+// Draw segments with glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count) and BOXES = false;
+// draw boxes with glDrawArraysInstanced(GL_TRIANGLES, 0, 6 * 12, count) and BOXES = true.
+struct LinesProgram {
+	LinesProgram();
+	~LinesProgram();
+
+	GLuint program = 0;
+	//Attribute (per-instance variable) locations:
+	GLuint A_vec3 = -1U;
+	GLuint B_vec3 = -1U;
+	GLuint Box0_vec3 = -1U;
+	GLuint Box1_vec3 = -1U;
+	GLuint Box2_vec3 = -1U;
+	GLuint Box3_vec3 = -1U;
+	GLuint Color_vec4 = -1U;
+	//Uniform (per-invocation variable) locations:
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint VIEWPORT_vec2 = -1U; //viewport size, in pixels
+	GLuint THICKNESS_float = -1U; //line width, in pixels
+	GLuint BOXES_bool = -1U; //draw boxes instead of segments
+	//Textures:
+	// none
+};
+
+extern Load< LinesProgram > lines_program;
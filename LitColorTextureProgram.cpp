@@ -2,26 +2,147 @@
 
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "ShaderWatcher.hpp"
 
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
 
-Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
-	LitColorTextureProgram *ret = new LitColorTextureProgram();
-
-	//----- build the pipeline template -----
+//built-in shader sources (when hot-reloading is on, these are read from files instead; see ShaderWatcher.hpp):
+static std::string const vertex_source =
+	"#version 330\n"
+	"uniform mat4 OBJECT_TO_CLIP;\n"
+	"uniform mat4x3 OBJECT_TO_LIGHT;\n"
+	"uniform mat3 NORMAL_TO_LIGHT;\n"
+	"in vec4 Position;\n"
+	"in vec3 Normal;\n"
+	"in vec4 Color;\n"
+	"in vec2 TexCoord;\n"
+	"invariant gl_Position;\n" //(matches DepthProgram, for depth pre-passes)
+	"out vec3 position;\n"
+	"out vec3 normal;\n"
+	"out vec4 color;\n"
+	"out vec2 texCoord;\n"
+	"void main() {\n"
+	"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+	"	position = OBJECT_TO_LIGHT * Position;\n"
+	"	normal = NORMAL_TO_LIGHT * Normal;\n"
+	"	color = Color;\n"
+	"	texCoord = TexCoord;\n"
+	"}\n";
+
+static std::string const fragment_source =
+	"#version 330\n"
+	"uniform sampler2D TEX;\n"
+	"struct LightInfo {\n" //matches Scene::LightInfo
+	"	vec4 position;\n"  //xyz: position, w: type
+	"	vec4 direction;\n" //xyz: direction, w: cos(cutoff)
+	"	vec4 energy;\n"    //xyz: energy, w: distance
+	"};\n"
+	"struct ShadowInfo {\n" //matches Scene::ShadowInfo
+	"	mat4 light_to_shadow;\n"
+	"	vec4 rect;\n"
+	"};\n"
+	"layout(std140) uniform Lights {\n"
+	"	uvec4 CLUSTER_GRID;\n" //matches Scene::ClusterInfo
+	"	vec4 CLUSTER_TILE;\n"
+	"	vec4 CLUSTER_DEPTH;\n"
+	"	ShadowInfo SHADOWS[" + std::to_string(Scene::MaxShadows) + "];\n"
+	"	LightInfo LIGHTS[" + std::to_string(Scene::MaxLights) + "];\n"
+	"};\n"
+	"uniform usamplerBuffer CLUSTER_RANGES;\n"
+	"uniform usamplerBuffer CLUSTER_INDICES;\n"
+	"uniform sampler2DShadow SHADOW_ATLAS;\n"
+	"const int MAX_OBJECT_LIGHTS = " + std::to_string(Scene::MaxObjectLights) + ";\n"
+	"uniform int LIGHT_COUNT;\n"
+	"uniform int LIGHT_INDICES[MAX_OBJECT_LIGHTS];\n"
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in vec4 color;\n"
+	"in vec2 texCoord;\n"
+	"out vec4 fragColor;\n"
+	"float shadow_visibility(int index) {\n"
+	"	vec4 s = SHADOWS[index].light_to_shadow * vec4(position, 1.0);\n"
+	"	s.xyz /= s.w;\n"
+	"	if (any(lessThan(s.xyz, vec3(0.0))) || any(greaterThan(s.xyz, vec3(1.0)))) return 1.0;\n" //(outside the map)
+	"	vec4 rect = SHADOWS[index].rect;\n"
+	"	vec2 texel = 0.5 / vec2(textureSize(SHADOW_ATLAS, 0));\n" //(keep filtering from reaching into the next map)
+	"	vec2 uv = clamp(rect.xy + s.xy * rect.zw, rect.xy + texel, rect.xy + rect.zw - texel);\n"
+	"	return texture(SHADOW_ATLAS, vec3(uv, s.z));\n"
+	"}\n"
+	"vec3 light_energy(LightInfo light, vec3 n) {\n"
+	"	int code = int(light.position.w + 0.5);\n"
+	"	int type = code & 3;\n"
+	"	int shadow = (code >> 2) - 1;\n"
+	"	float visibility = (shadow >= 0 ? shadow_visibility(shadow) : 1.0);\n"
+	"	vec3 dir = light.direction.xyz;\n"
+	"	if (type == 0 || type == 2) { //point or spot light \n"
+	"		vec3 l = (light.position.xyz - position);\n"
+	"		float dis2 = dot(l,l);\n"
+	"		l = normalize(l);\n"
+	"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+	"		float fade = clamp(1.0 - dis2 * dis2 / pow(light.energy.w, 4.0), 0.0, 1.0);\n" //fade out to zero at distance
+	"		nl *= fade * fade;\n"
+	"		if (type == 2) {\n"
+	"			float c = dot(l,-dir);\n"
+	"			float cutoff = light.direction.w;\n"
+	"			nl *= smoothstep(cutoff,mix(cutoff,1.0,0.1), c);\n"
+	"		}\n"
+	"		return visibility * nl * light.energy.rgb;\n"
+	"	} else if (type == 1) { //hemi light \n"
+	"		return (dot(n,-dir) * 0.5 + 0.5) * light.energy.rgb;\n"
+	"	} else { //(type == 3) //directional light \n"
+	"		return visibility * max(0.0, dot(n,-dir)) * light.energy.rgb;\n"
+	"	}\n"
+	"}\n"
+	"void main() {\n"
+	"	vec3 n = normalize(normal);\n"
+	"	vec3 e = vec3(0.0);\n"
+	"	if (CLUSTER_GRID.x != 0u) {\n"
+	//find this fragment's cluster (view depth comes from window z, since Camera uses an infinite perspective projection):
+	"		ivec2 tile = ivec2((gl_FragCoord.xy - CLUSTER_TILE.zw) * CLUSTER_TILE.xy);\n"
+	"		float depth = CLUSTER_DEPTH.x / max(1e-7, 1.0 - gl_FragCoord.z);\n"
+	"		int slice = int(log(depth / CLUSTER_DEPTH.x) * CLUSTER_DEPTH.y);\n"
+	"		ivec3 c = clamp(ivec3(tile, slice), ivec3(0), ivec3(CLUSTER_GRID.xyz) - 1);\n"
+	"		int cluster = (c.z * int(CLUSTER_GRID.y) + c.y) * int(CLUSTER_GRID.x) + c.x;\n"
+	"		uvec2 range = texelFetch(CLUSTER_RANGES, cluster).xy;\n"
+	"		for (uint i = 0u; i < range.y; ++i) {\n"
+	"			int index = int(texelFetch(CLUSTER_INDICES, int(range.x + i)).x);\n"
+	"			e += light_energy(LIGHTS[index], n);\n"
+	"		}\n"
+	"	} else {\n"
+	"		for (int i = 0; i < MAX_OBJECT_LIGHTS; ++i) {\n" //(fixed-count loop; exits early once past LIGHT_COUNT)
+	"			if (i >= LIGHT_COUNT) break;\n"
+	"			e += light_energy(LIGHTS[LIGHT_INDICES[i]], n);\n"
+	"		}\n"
+	"	}\n"
+	"	vec4 albedo = texture(TEX, texCoord) * color;\n"
+	"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
+	"}\n";
+
+//(sources are picked when submitted, since hot-reloading is turned on after globals are constructed)
+static SubmittedProgram submitted_program("LitColorTextureProgram",
+	[]() { return shader_source("LitColorTextureProgram.vert", vertex_source); },
+	[]() { return shader_source("LitColorTextureProgram.frag", fragment_source); }
+);
+
+//point the pipeline template at a program:
+static void set_pipeline_program(LitColorTextureProgram const *ret) {
 	lit_color_texture_program_pipeline.program = ret->program;
+	lit_color_texture_program_pipeline.invariant_position = true; //(see vertex shader)
 
 	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
 	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
 
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	lit_color_texture_program_pipeline.LIGHT_COUNT_int = ret->LIGHT_COUNT_int;
+	lit_color_texture_program_pipeline.LIGHT_INDICES_int_array = ret->LIGHT_INDICES_int_array;
+}
+
+Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	//wait for the program submitted above to finish compiling (throws on errors):
+	LitColorTextureProgram *ret = new LitColorTextureProgram(submitted_program.finish());
+
+	//----- build the pipeline template -----
+	set_pipeline_program(ret);
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -40,74 +161,13 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	lit_color_texture_program_pipeline.textures[0].texture = tex;
 	lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
 
+	//----- hot-reloading (if enabled) -----
+	watch_shader_program(lit_color_texture_program, "LitColorTextureProgram", "LitColorTextureProgram.vert", "LitColorTextureProgram.frag", set_pipeline_program);
+
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
-		"out vec3 position;\n"
-		"out vec3 normal;\n"
-		"out vec4 color;\n"
-		"out vec2 texCoord;\n"
-		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
-		"	color = Color;\n"
-		"	texCoord = TexCoord;\n"
-		"}\n"
-	,
-		//fragment shader:
-		"#version 330\n"
-		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
-		"	}\n"
-		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
-		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
-		"}\n"
-	);
-	//As you can see above, adjacent strings in C/C++ are concatenated.
-	// this is very useful for writing long shader programs inline.
+LitColorTextureProgram::LitColorTextureProgram(GLuint program_) : program(program_) {
 
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
@@ -120,19 +180,28 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	LIGHT_COUNT_int = glGetUniformLocation(program, "LIGHT_COUNT");
+	LIGHT_INDICES_int_array = glGetUniformLocation(program, "LIGHT_INDICES");
+
+	//lights are read from the uniform buffer Scene::draw binds at Scene::LightsBinding:
+	GLuint Lights_block = glGetUniformBlockIndex(program, "Lights");
+	if (Lights_block != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, Lights_block, Scene::LightsBinding);
+	}
 
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint CLUSTER_RANGES_usamplerBuffer = glGetUniformLocation(program, "CLUSTER_RANGES");
+	GLuint CLUSTER_INDICES_usamplerBuffer = glGetUniformLocation(program, "CLUSTER_INDICES");
+	GLuint SHADOW_ATLAS_sampler2DShadow = glGetUniformLocation(program, "SHADOW_ATLAS");
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	glUniform1i(CLUSTER_RANGES_usamplerBuffer, GLint(Scene::ClusterRangesUnit)); //cluster lists are bound by Scene::draw
+	glUniform1i(CLUSTER_INDICES_usamplerBuffer, GLint(Scene::ClusterIndicesUnit));
+	glUniform1i(SHADOW_ATLAS_sampler2DShadow, GLint(Scene::ShadowAtlasUnit)); //(as is the shadow atlas)
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
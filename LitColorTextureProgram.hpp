@@ -6,7 +6,8 @@
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	//takes ownership of a linked program and looks up its attribute and uniform locations:
+	LitColorTextureProgram(GLuint program);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -22,12 +23,9 @@ struct LitColorTextureProgram {
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
 
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
+	//lighting (light data itself is in the "Lights" uniform block; see Scene::LightInfo):
+	GLuint LIGHT_COUNT_int = -1U;
+	GLuint LIGHT_INDICES_int_array = -1U;
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
@@ -26,6 +26,7 @@
 #include <stdexcept>
 
 enum LoadTag : uint32_t {
+	LoadTagShaders, //for submitting shader programs (see gl_submit_program), so they compile in parallel before anything uses them
 	LoadTagEarly,
 	LoadTagDefault,
 	LoadTagLate,
@@ -30,6 +30,7 @@ if (maek.OS === "windows") {
 		`/I${NEST_LIBS}/SDL2/include`,
 		`/I${NEST_LIBS}/glm/include`,
 		`/I${NEST_LIBS}/libpng/include`,
+		`/I${NEST_LIBS}/zlib/include`,
 		`/I${NEST_LIBS}/opusfile/include`,
 		`/I${NEST_LIBS}/libopus/include`,
 		`/I${NEST_LIBS}/libogg/include`,
@@ -60,6 +61,7 @@ if (maek.OS === "windows") {
 		`-I${NEST_LIBS}/SDL2/include/SDL2`, `-D_THREAD_SAFE`, //the output of sdl-config --cflags
 		`-I${NEST_LIBS}/glm/include`,
 		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`,
 		`-I${NEST_LIBS}/opusfile/include`,
 		`-I${NEST_LIBS}/libopus/include`,
 		`-I${NEST_LIBS}/libogg/include`,
@@ -84,6 +86,7 @@ if (maek.OS === "windows") {
 		`-I${NEST_LIBS}/SDL2/include/SDL2`, `-D_THREAD_SAFE`, //the output of sdl-config --cflags
 		`-I${NEST_LIBS}/glm/include`,
 		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`,
 		`-I${NEST_LIBS}/opusfile/include`,
 		`-I${NEST_LIBS}/libopus/include`,
 		`-I${NEST_LIBS}/libogg/include`,
@@ -137,10 +140,18 @@ if (maek.OS === 'windows') {
 //returns objFile: objFileBase + a platform-dependant suffix ('.o' or '.obj')
 const game_names = [
 	maek.CPP('PlayMode.cpp'),
+	maek.CPP('GlyphAtlas.cpp'),
+	maek.CPP('ShapeCache.cpp'),
+	maek.CPP('TextLayout.cpp'),
 	maek.CPP('main.cpp'),
-	maek.CPP('LitColorTextureProgram.cpp'),
+	maek.CPP('FrameCapture.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
+];
+
+const sound_names = [
 	maek.CPP('Sound.cpp'),
+	maek.CPP('SoundEffects.cpp'),
+	maek.CPP('resample.cpp'),
 	maek.CPP('load_wav.cpp'),
 	maek.CPP('load_opus.cpp')
 ];
@@ -150,11 +161,21 @@ const common_names = [
 	maek.CPP('PathFont.cpp'),
 	maek.CPP('PathFont-font.cpp'),
 	maek.CPP('DrawLines.cpp'),
+	maek.CPP('LinesProgram.cpp'),
 	maek.CPP('ColorProgram.cpp'),
+	maek.CPP('LitColorTextureProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('LightClusters.cpp'),
+	maek.CPP('ShadowAtlas.cpp'),
+	maek.CPP('DepthProgram.cpp'),
+	maek.CPP('DrawPasses.cpp'),
 	maek.CPP('Mesh.cpp'),
 	maek.CPP('load_save_png.cpp'),
+	maek.CPP('gl_load_png_texture.cpp'),
+	maek.CPP('load_save_texture.cpp'),
+	maek.CPP('gl_load_texture.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
+	maek.CPP('ShaderWatcher.cpp'),
 	maek.CPP('Mode.cpp'),
 	maek.CPP('GL.cpp'),
 	maek.CPP('Load.cpp')
@@ -176,18 +197,42 @@ const freetype_test_names = [
 	maek.CPP('freetype-test.cpp')
 ];
 
+const sound_bench_names = [
+	maek.CPP('sound-bench.cpp')
+];
+
+const png_bench_names = [
+	maek.CPP('png-bench.cpp')
+];
+
+const texture_pack_names = [
+	maek.CPP('texture-pack.cpp')
+];
+
+const cluster_bench_names = [
+	maek.CPP('cluster-bench.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
-const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
+const game_exe = maek.LINK([...game_names, ...sound_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
 
 const freetype_test_exe = maek.LINK([...freetype_test_names], 'freetype-test');
 
+const sound_bench_exe = maek.LINK([...sound_bench_names, ...sound_names], 'sound-bench');
+
+const png_bench_exe = maek.LINK([...png_bench_names, ...common_names], 'png-bench');
+
+const texture_pack_exe = maek.LINK([...texture_pack_names, ...common_names], 'texture-pack');
+
+const cluster_bench_exe = maek.LINK([...cluster_bench_names, ...common_names], 'cluster-bench');
+
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, freetype_test_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, freetype_test_exe, sound_bench_exe, png_bench_exe, texture_pack_exe, cluster_bench_exe, ...copies];
 
 //the '[targets =] RULE(targets, prerequisites[, recipe])' rule defines a Makefile-style task
 // targets: array of targets the task produces (can include both files and ':abstract targets')
@@ -14,11 +14,59 @@ PathFont::PathFont(uint32_t glyphs_,
 		glyph_char_starts(glyph_char_starts_), chars(chars_),
 		glyph_coord_starts(glyph_coord_starts_), coords(coords_) {
 
+	trie.emplace_back(); //root node (empty string)
+	trie_roots.fill(0);
+
 	for (uint32_t i = 0; i < glyphs; ++i) {
 		std::string str(reinterpret_cast< const char * >(chars + glyph_char_starts[i]), reinterpret_cast< const char * >(chars + glyph_char_starts[i+1]));
 		auto res = glyph_map.insert(std::make_pair(str, i));
 		if (!res.second) {
 			std::cerr << "WARNING: ignoring duplicate glyph for '" << str << "'." << std::endl;
+			continue;
+		}
+
+		//add to trie:
+		uint32_t node = 0;
+		for (char c : str) {
+			uint8_t byte = uint8_t(c);
+			uint32_t next = 0;
+			for (auto const &child : trie[node].children) {
+				if (child.first == byte) next = child.second;
+			}
+			if (next == 0) {
+				next = uint32_t(trie.size());
+				trie[node].children.emplace_back(byte, next);
+				trie.emplace_back();
+				if (node == 0) trie_roots[byte] = next;
+			}
+			node = next;
+		}
+		trie[node].glyph = i;
+	}
+}
+
+uint32_t PathFont::match(const char *text, size_t length, size_t *matched) const {
+	uint32_t glyph = -1U;
+	*matched = 0;
+	if (length == 0) return glyph;
+
+	uint32_t node = trie_roots[uint8_t(text[0])];
+	size_t at = 1;
+	while (node != 0) {
+		if (trie[node].glyph != -1U) {
+			glyph = trie[node].glyph;
+			*matched = at;
+		}
+		if (at == length) break;
+		uint32_t next = 0;
+		for (auto const &child : trie[node].children) {
+			if (child.first == uint8_t(text[at])) {
+				next = child.second;
+				break;
+			}
 		}
+		node = next;
+		at += 1;
 	}
+	return glyph;
 }
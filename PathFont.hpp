@@ -10,6 +10,7 @@
 
 #include <glm/glm.hpp>
 
+#include <array>
 #include <string>
 #include <vector>
 #include <map>
@@ -33,6 +34,18 @@ struct PathFont {
 	//computed in constructor:
 	std::map< std::string, uint32_t > glyph_map;
 
+	//find the glyph matching the longest prefix of text[0,length):
+	// returns the glyph index (or -1U if no glyph matches) and sets *matched to the prefix length
+	uint32_t match(const char *text, size_t length, size_t *matched) const;
+
+	//glyph strings in a trie (also computed in constructor), so match() doesn't need to build strings:
+	struct TrieNode {
+		uint32_t glyph = -1U; //glyph whose string ends at this node
+		std::vector< std::pair< uint8_t, uint32_t > > children; //(byte, node index)
+	};
+	std::vector< TrieNode > trie;
+	std::array< uint32_t, 256 > trie_roots; //node for each first byte (0 == none, since node 0 is the empty string)
+
 	//the default font:
 	static PathFont font;
 };
@@ -7,164 +7,56 @@
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
+#include "gl_compile_program.hpp"
+#include "ShaderWatcher.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <fstream>
+#include <iostream>
 
 #include <random>
 
 void PlayMode::load_lines_from_file(std::string filename) {
 	lines.clear();
+	line_runs.clear();
   std::ifstream input(filename);
   for (std::string line; getline(input, line);) {
 		lines.push_back(line);
+		//shape once now, so drawing doesn't need to:
+		line_runs.push_back(shapes->shape(line));
   }
-}
-
-void PlayMode::draw_text_lines(glm::uvec2 const &drawable_size, float x, float y) {
-	size_t counter = 0;
-	for( size_t i=0;i<lines.size();i++) {
-		std::string line = lines[i];
-		if (counter + line.size() <= letter_counter) {
-			counter += line.size();
-			draw_text_line(line,drawable_size,x,y);
-		} else if (counter < letter_counter) {
-			draw_text_line(line.substr(0,letter_counter - counter),drawable_size,x,y);
-			counter = letter_counter;
-		}
-		
-		y -= ft_face->size->metrics.height / (64.f * (float)drawable_size.y);
-	}
+	//...and lay out all the glyphs:
+	layout->build(lines, line_runs, ft_face, *atlas, glyph_scale);
 }
 
 // https://gedge.ca/blog/2013-12-08-opengl-text-rendering-with-freetype
 // https://www.freetype.org/freetype2/docs/tutorial/step1.html
 // https://github.com/harfbuzz/harfbuzz-tutorial/blob/master/hello-harfbuzz-freetype.c
-void PlayMode::draw_text_line(std::string s, glm::uvec2 const &drawable_size, float current_x, float current_y) {
-
-  const char *text = s.c_str();
-
-	/* Create hb-buffer and populate. */
-  hb_buffer_t *hb_buffer = hb_buffer_create ();
-  hb_buffer_add_utf8 (hb_buffer, text, -1, 0, -1);
-  hb_buffer_guess_segment_properties (hb_buffer);
-
-  /* Shape it! */
-  hb_shape (hb_font, hb_buffer, NULL, 0);
-
-  /* Get glyph information and positions out of the buffer. */
-  unsigned int len = hb_buffer_get_length (hb_buffer);
-  hb_glyph_info_t *info = hb_buffer_get_glyph_infos (hb_buffer, NULL);
-  hb_glyph_position_t *pos = hb_buffer_get_glyph_positions (hb_buffer, NULL);
-
-  /* And converted to absolute positions. */
-  {
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); 
-
-    for (unsigned int i = 0; i < len; i++)
-    {
-      hb_codepoint_t glyph_index   = info[i].codepoint;
-
-			/* load glyph image into the slot (erase previous one) */
-  		FT_Error error = FT_Load_Glyph( ft_face, glyph_index, FT_LOAD_DEFAULT );
-  		if ( error )
-    		continue;  /* ignore errors */
-
-			/* convert to an anti-aliased bitmap */
-  		error = FT_Render_Glyph( ft_face->glyph, FT_RENDER_MODE_NORMAL );
-  		if ( error )
-    		continue;
-
-
-      float x_position = current_x + (pos[i].x_offset + 400 * 64.f) / (64.f * drawable_size.x);
-      float y_position = current_y + ((pos[i].y_offset / 64.f) - ((ft_face->bbox.yMax - ft_face->bbox.yMin) - ft_face->glyph->metrics.horiBearingY) / 64.f) / (drawable_size.y);
-
-			FT_Bitmap *bm = &ft_face->glyph->bitmap;
-			// FT_PIXEL_MODE_GRAY
-			// each pixel stored in 8 bits
-
-    	glTexImage2D(
-      	GL_TEXTURE_2D,
-        0,
-        GL_R8,
-        ft_face->glyph->bitmap.width,
-        ft_face->glyph->bitmap.rows,
-        0,
-        GL_RED,
-        GL_UNSIGNED_BYTE,
-        ft_face->glyph->bitmap.buffer
-    	);
-
-      const float w = bm->width / (float)drawable_size.x;
-      const float h = bm->rows/ (float)drawable_size.y;
-
-      struct {
-      	float x, y, s, t;
-      } data[6] = {
-      	{x_position    , y_position    , 0, 0},
-        {x_position    , y_position - h, 0, 1},
-        {x_position + w, y_position    , 1, 0},
-        {x_position + w, y_position    , 1, 0},
-        {x_position    , y_position - h, 0, 1},
-        {x_position + w, y_position - h, 1, 1}
-      };
-
-      glBufferData(GL_ARRAY_BUFFER, 24*sizeof(float), data, GL_DYNAMIC_DRAW);
-      glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-      glDrawArrays(GL_TRIANGLES, 0, 6);
-
-      current_x += (pos[i].x_advance) / (64.f * drawable_size.x);
-      current_y += pos[i].y_advance / (64.f * drawable_size.y);
-
-			assert(current_x <= 1.0);
-			assert(current_y <= 1.0);
-    }
-  }
-
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+void PlayMode::draw_text_lines(glm::uvec2 const &drawable_size, float x, float y) {
+	//text may need to be laid out again if the atlas evicted any glyphs:
+	if (layout->stale(*atlas)) {
+		layout->build(lines, line_runs, ft_face, *atlas, glyph_scale);
+	}
 
-	GL_ERRORS();
+	//layout is in pixels relative to its upper left corner, which goes at (x,y) in clip space:
+	glUniform2f(originUniform, x, y);
+	glUniform2f(pixelToClipUniform, 1.0f / drawable_size.x, 1.0f / drawable_size.y);
 
+	//typewriter effect -- only first letter_counter bytes of text are shown:
+	layout->draw(letter_counter);
 }
 
 PlayMode::PlayMode() {
 
-	// Initialize our texture and VBOs
-  glGenBuffers(1, &vbo);
-  glGenVertexArrays(1, &vao);
-  glGenTextures(1, &texture);
+	// Initialize our sampler
   glGenSamplers(1, &sampler);
   glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	// Initialize shader
-  vs = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vs, 1, &VERTEX_SHADER, 0);
-  glCompileShader(vs);
-
-  fs = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fs, 1, &FRAGMENT_SHADER, 0);
-  glCompileShader(fs);
-
-  program = glCreateProgram();
-  glAttachShader(program, vs);
-  glAttachShader(program, fs);
-  glLinkProgram(program);
-
-  // Set some initialize GL state
-  glEnable(GL_BLEND);
-  glDisable(GL_CULL_FACE);
-  glDisable(GL_DEPTH_TEST);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glClearColor(0, 0, 0, 1);
-
-  // Get shader uniforms
-  glUseProgram(program);
-  texUniform = glGetUniformLocation(program, "tex");
-
 	#define FONT_SIZE 120
+	#define SDF_SIZE 48
 
 	// https://www.1001fonts.com/risque-font.html
 	std::string fontfile = data_path("../scenes/Risque-Regular.ttf");
@@ -181,6 +73,54 @@ PlayMode::PlayMode() {
 
   /* Create hb-ft font. */
   hb_font = hb_ft_font_create (ft_face, NULL);
+	shapes.reset(new ShapeCache(hb_font, FONT_SIZE));
+
+	/* Glyphs get rasterized into this atlas as they are needed. */
+	/* Prefer signed distance fields, rasterized from a separate (smaller) face so the shaping face keeps its size. */
+	if (use_sdf) {
+		try {
+			if ((ft_error = FT_New_Face (ft_library, fontfile.c_str(), 0, &sdf_face)))
+				throw std::runtime_error("failed to open font for SDF glyphs");
+			if ((ft_error = FT_Set_Char_Size (sdf_face, SDF_SIZE*64, SDF_SIZE*64, 0, 0)))
+				throw std::runtime_error("failed to set SDF glyph size");
+			atlas.reset(new GlyphAtlas(sdf_face, 512, GlyphAtlas::SDF));
+			glyph_scale = FONT_SIZE / float(SDF_SIZE);
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: not using SDF text (" << e.what() << "); falling back to coverage glyphs." << std::endl;
+			if (sdf_face) {
+				FT_Done_Face(sdf_face);
+				sdf_face = nullptr;
+			}
+			use_sdf = false;
+		}
+	}
+	if (!use_sdf) {
+		atlas.reset(new GlyphAtlas(ft_face));
+		glyph_scale = 1.0f;
+	}
+
+	/* Text for each level gets laid out once, when it is loaded. */
+	layout.reset(new TextLayout());
+
+	// Initialize shader (sources are read from shaders/ when hot-reloading; see ShaderWatcher.hpp)
+	std::string vertex_file = "PlayMode-text.vert";
+	std::string fragment_file = (use_sdf ? "PlayMode-sdf-text.frag" : "PlayMode-text.frag");
+	text_program_name = (use_sdf ? "PlayMode SDF text" : "PlayMode text");
+	set_text_program(gl_finish_program(gl_submit_program(text_program_name,
+		shader_source(vertex_file, VERTEX_SHADER),
+		shader_source(fragment_file, (use_sdf ? SDF_FRAGMENT_SHADER : FRAGMENT_SHADER))
+	)));
+	watch_shader_program(text_program_name, vertex_file, fragment_file, [this](GLuint new_program) -> GLuint {
+		GLuint old_program = program;
+		set_text_program(new_program);
+		return old_program;
+	});
+
+  // Set some initialize GL state
+  // (blending is turned on only while drawing text; see draw())
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_DEPTH_TEST);
+  glClearColor(0, 0, 0, 1);
 
 	current_level = 0;
 	current_elapsed = 0.f;
@@ -188,7 +128,32 @@ PlayMode::PlayMode() {
 	load_lines_from_file(data_path(levels[current_level]));
 }
 
+void PlayMode::set_text_program(GLuint program_) {
+	program = program_;
+
+  // Get shader uniforms
+  texUniform = glGetUniformLocation(program, "tex");
+	originUniform = glGetUniformLocation(program, "origin");
+	pixelToClipUniform = glGetUniformLocation(program, "pixel_to_clip");
+	if (use_sdf) {
+		colorUniform = glGetUniformLocation(program, "color");
+		outlineColorUniform = glGetUniformLocation(program, "outline_color");
+		outlineWidthUniform = glGetUniformLocation(program, "outline_width");
+		glowColorUniform = glGetUniformLocation(program, "glow_color");
+		glowWidthUniform = glGetUniformLocation(program, "glow_width");
+	}
+}
+
 PlayMode::~PlayMode() {
+	unwatch_shader_program(text_program_name);
+	glDeleteProgram(program);
+	program = 0;
+	layout.reset();
+	atlas.reset();
+	line_runs.clear();
+	shapes.reset();
+	hb_font_destroy(hb_font);
+	if (sdf_face) FT_Done_Face(sdf_face);
 	FT_Done_Face(ft_face);
 	FT_Done_FreeType(ft_library);
 }
@@ -250,20 +215,30 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
+	//text quads all sit at z=0 and (SDF glyphs being padded) overlap their neighbours,
+	// so depth testing would clip each glyph against the previous glyph's transparent padding:
+	glDisable(GL_DEPTH_TEST);
 
 	// Bind stuff
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture);
+  glBindTexture(GL_TEXTURE_2D, atlas->tex);
   glBindSampler(0, sampler);
-  glBindVertexArray(vao);
-  glEnableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glUseProgram(program);
   glUniform1i(texUniform, 0);
+	if (use_sdf) {
+		glUniform4fv(colorUniform, 1, glm::value_ptr(text_color));
+		glUniform4fv(outlineColorUniform, 1, glm::value_ptr(outline_color));
+		glUniform1f(outlineWidthUniform, outline_width);
+		glUniform4fv(glowColorUniform, 1, glm::value_ptr(glow_color));
+		glUniform1f(glowWidthUniform, glow_width);
+	}
 
+	atlas->next_frame();
+	//text quads are the only blended things PlayMode draws:
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	draw_text_lines(drawable_size,-0.8,0.8);
+	glDisable(GL_BLEND);
 
 	GL_ERRORS();
 }
@@ -2,6 +2,9 @@
 
 #include "Scene.hpp"
 #include "Sound.hpp"
+#include "GlyphAtlas.hpp"
+#include "ShapeCache.hpp"
+#include "TextLayout.hpp"
 
 #include <glm/glm.hpp>
 
@@ -10,6 +13,7 @@
 
 #include <vector>
 #include <deque>
+#include <memory>
 
 struct PlayMode : Mode {
 	PlayMode();
@@ -28,17 +32,22 @@ struct PlayMode : Mode {
 		uint8_t pressed = 0;
 	} a, b, c;
 
-	void draw_text_line(std::string s, glm::uvec2 const &drawable_size, float x, float y);
+	//draw the first letter_counter bytes of the (already laid out) lines, with upper left at (x,y) in clip space:
 	void draw_text_lines(glm::uvec2 const &drawable_size, float x, float y);
 	void load_lines_from_file(std::string filename);
 
-	GLuint texture{0}, sampler{0};
-  GLuint vbo{0}, vao{0};
-  GLuint vs{0}, fs{0}, program{0};
-	GLuint texUniform{0};
+	GLuint sampler{0};
+	//text shader program (and its uniform locations):
+	void set_text_program(GLuint program);
+	std::string text_program_name; //(for shader cache and hot-reloading)
+	GLuint program{0};
+	GLuint texUniform{0}, originUniform{0}, pixelToClipUniform{0};
+	GLuint colorUniform{0}, outlineColorUniform{0}, outlineWidthUniform{0}, glowColorUniform{0}, glowWidthUniform{0};
 
 	size_t letter_counter{0};
 	std::vector<std::string> lines;
+	std::vector< std::shared_ptr< ShapeCache::Run const > > line_runs; //lines, already shaped
+	std::unique_ptr< TextLayout > layout; //lines, already laid out (built by load_lines_from_file)
 	float current_elapsed = 0.0;
 	float max_elapsed = 0.03;
 
@@ -49,14 +58,35 @@ struct PlayMode : Mode {
   FT_Face ft_face;
 	FT_Library ft_library;
 
+	//SDF text: glyphs come from a smaller face and are scaled up by glyph_scale when drawn
+	// (falls back to coverage glyphs from ft_face if SDF rendering isn't available):
+	bool use_sdf = GLYPH_ATLAS_HAS_SDF;
+	FT_Face sdf_face = nullptr;
+	float glyph_scale = 1.0f;
+
+	//SDF text style (outline and glow widths are in distance-field units -- 0.5 is the whole 8-pixel SDF spread; 0.0 for none):
+	glm::vec4 text_color = glm::vec4(0.388f, 0.765f, 0.196f, 1.0f);
+	glm::vec4 outline_color = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	float outline_width = 0.0f;
+	glm::vec4 glow_color = glm::vec4(1.0f, 0.9f, 0.4f, 0.5f);
+	float glow_width = 0.0f;
+
 	hb_font_t *hb_font;
 
+	//rasterized glyphs (created after ft_face's size is set):
+	std::unique_ptr< GlyphAtlas > atlas;
+
+	//shaped lines of text (created after hb_font):
+	std::unique_ptr< ShapeCache > shapes;
+
 	const char *VERTEX_SHADER = ""
         "#version 330\n"
+        "uniform vec2 origin;\n"
+        "uniform vec2 pixel_to_clip;\n"
         "in vec4 position;\n"
         "out vec2 texCoords;\n"
         "void main(void) {\n"
-        "    gl_Position = vec4(position.xy, 0, 1);\n"
+        "    gl_Position = vec4(origin + position.xy * pixel_to_clip, 0, 1);\n"
         "    texCoords = position.zw;\n"
         "}\n";
 
@@ -71,4 +101,27 @@ struct PlayMode : Mode {
         "    fragColor = vec4(1, 1, 1, texture(tex, texCoords).r) * color;\n"
         "}\n";
 
+	//signed-distance-field glyphs (0.5 at the edge of the glyph, larger inside):
+	const char *SDF_FRAGMENT_SHADER = ""
+        "#version 330\n"
+        "uniform sampler2D tex;\n"
+        "uniform vec4 color;\n"
+        "uniform vec4 outline_color;\n"
+        "uniform float outline_width;\n"
+        "uniform vec4 glow_color;\n"
+        "uniform float glow_width;\n"
+        "in vec2 texCoords;\n"
+        "out vec4 fragColor;\n"
+        "void main(void) {\n"
+        "    float d = texture(tex, texCoords).r - 0.5;\n"
+        "    float aa = max(0.7 * fwidth(d), 1e-4);\n"
+        "    float fill = smoothstep(-aa, aa, d);\n"
+        "    float edge = smoothstep(-aa, aa, d + outline_width);\n"
+        "    vec4 c = mix(outline_color, color, fill);\n"
+        "    float a = c.a * edge;\n"
+        "    float g = (glow_width > 0.0 ? glow_color.a * smoothstep(-glow_width, 0.0, d + outline_width) : 0.0) * (1.0 - a);\n"
+        "    float alpha = a + g;\n"
+        "    fragColor = vec4((c.rgb * a + glow_color.rgb * g) / max(alpha, 1e-4), alpha);\n"
+        "}\n";
+
 };
@@ -1,11 +1,18 @@
 #include "Scene.hpp"
 
+#include "DepthProgram.hpp"
+#include "DrawPasses.hpp"
+#include "LightClusters.hpp"
+#include "ShadowAtlas.hpp"
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <limits>
 
 //-------------------------
 
@@ -73,6 +80,20 @@ glm::mat4x3 Scene::Transform::make_world_to_local() const {
 
 //-------------------------
 
+bool Scene::Drawable::bounding_sphere(glm::vec3 *center, float *radius) const {
+	assert(center && radius);
+	if (!(bbox_min.x <= bbox_max.x)) return false;
+
+	assert(transform);
+	glm::mat4x3 object_to_world = transform->make_local_to_world();
+	*center = object_to_world * glm::vec4(0.5f * (bbox_min + bbox_max), 1.0f);
+	float scale = std::max(glm::length(object_to_world[0]), std::max(glm::length(object_to_world[1]), glm::length(object_to_world[2])));
+	*radius = 0.5f * glm::length(bbox_max - bbox_min) * scale;
+	return true;
+}
+
+//-------------------------
+
 glm::mat4 Scene::Camera::make_projection() const {
 	return glm::infinitePerspective( fovy, aspect, near );
 }
@@ -87,20 +108,237 @@ void Scene::draw(Camera const &camera) const {
 	draw(world_to_clip, world_to_light);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+//helpers for sending lights to the GPU and picking the ones that reach each drawable:
+namespace {
+	//world-space description of a light, used for culling:
+	struct LightBounds {
+		Scene::Light::Type type;
+		glm::vec3 position;
+		glm::vec3 direction;
+		float distance;
+		float cos_cutoff, sin_cutoff;
+		float brightness; //largest energy component
+	};
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	//does a light reach a (world-space) bounding sphere?
+	bool light_reaches(LightBounds const &light, glm::vec3 const &center, float radius) {
+		if (light.type == Scene::Light::Hemisphere || light.type == Scene::Light::Directional) return true;
+
+		glm::vec3 to_center = center - light.position;
+		float dis2 = glm::dot(to_center, to_center);
+		if (dis2 > (light.distance + radius) * (light.distance + radius)) return false;
+		if (light.type == Scene::Light::Point) return true;
+
+		//spot light: sphere vs. cone test
+		float along = glm::dot(to_center, light.direction);
+		float across = std::sqrt(std::max(0.0f, dis2 - along * along));
+		float closest = light.cos_cutoff * across - light.sin_cutoff * along; //distance from sphere center to cone surface
+		if (closest > radius) return false;
+		if (along < -radius) return false; //entirely behind the light
+		return true;
+	}
+
+	//uniform buffer holding LightInfo for the current draw:
+	GLuint lights_buffer = 0;
+
+	//sort 'items' by their 16-bit keys (stable; two 8-bit LSD radix passes):
+	void radix_sort(std::vector< std::pair< uint16_t, uint32_t > > &items, std::vector< std::pair< uint16_t, uint32_t > > &scratch) {
+		scratch.resize(items.size());
+		for (uint32_t shift = 0; shift < 16; shift += 8) {
+			uint32_t offsets[256 + 1] = { 0 };
+			for (auto const &item : items) ++offsets[((item.first >> shift) & 0xff) + 1];
+			//everything in one bucket? nothing to do for this digit:
+			if (offsets[((items.empty() ? 0 : items[0].first >> shift) & 0xff) + 1] == items.size()) continue;
+			for (uint32_t b = 0; b < 256; ++b) offsets[b + 1] += offsets[b];
+			for (auto const &item : items) scratch[offsets[(item.first >> shift) & 0xff]++] = item;
+			items.swap(scratch);
+		}
+	}
+
+	//put 'to_draw' in nearest-first (or farthest-first) order, by (quantized) depth of bounding sphere center:
+	void sort_by_depth(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > &to_draw, bool farthest_first) {
+		if (to_draw.size() < 2) return;
+
+		//scratch space, reused between draws:
+		static std::vector< float > depths;
+		static std::vector< std::pair< uint16_t, uint32_t > > items, scratch;
+		static std::vector< Scene::Drawable const * > sorted;
+
+		depths.clear();
+		float lo = std::numeric_limits< float >::infinity();
+		float hi = -std::numeric_limits< float >::infinity();
+		for (Scene::Drawable const *drawable : to_draw) {
+			glm::vec3 center;
+			float radius;
+			if (!drawable->bounding_sphere(&center, &radius)) {
+				center = drawable->transform->make_local_to_world()[3];
+			}
+			//(clip-space z increases with view depth for both perspective and orthographic projections)
+			float depth = (world_to_clip * glm::vec4(center, 1.0f)).z;
+			depths.emplace_back(depth);
+			lo = std::min(lo, depth);
+			hi = std::max(hi, depth);
+		}
+
+		//quantize depths to 16 bits over the range actually used:
+		float scale = (hi > lo ? 65535.0f / (hi - lo) : 0.0f);
+		items.clear();
+		for (uint32_t i = 0; i < depths.size(); ++i) {
+			float q = std::max(0.0f, std::min(65535.0f, (depths[i] - lo) * scale));
+			uint16_t key = uint16_t(q);
+			if (farthest_first) key = uint16_t(0xffff - key);
+			items.emplace_back(key, i);
+		}
+		radix_sort(items, scratch);
+
+		sorted.clear();
+		for (auto const &item : items) sorted.emplace_back(to_draw[item.second]);
+		to_draw.swap(sorted);
+	}
+}
+
+void Scene::draw(Camera const &camera, LightClusters *clusters, ShadowAtlas const *shadows, DrawPasses *passes) const {
+	if (clusters) {
+		clusters->update(camera, lights);
+		clusters->upload();
+	}
+
+	assert(camera.transform);
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
+	draw(world_to_clip, world_to_light, clusters, shadows, passes);
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, LightClusters const *clusters, ShadowAtlas const *shadows, DrawPasses *passes) const {
+
+	//Gather lights (in world space for culling, in light space for the shaders):
+	std::vector< LightBounds > light_bounds;
+	std::vector< LightInfo > light_infos;
+	std::vector< ShadowInfo > shadow_infos;
+	//(shadow maps are made in world space, but shaders work in light space)
+	glm::mat4 light_space_to_world = glm::inverse(glm::mat4(world_to_light));
+	light_bounds.reserve(std::min< size_t >(lights.size(), MaxLights));
+	light_infos.reserve(light_bounds.capacity());
+	for (auto const &light : lights) {
+		if (light_infos.size() == MaxLights) {
+			static bool warned = false;
+			if (!warned) {
+				std::cerr << "WARNING: scene has more than " << MaxLights << " lights; ignoring the rest." << std::endl;
+				warned = true;
+			}
+			break;
+		}
+		assert(light.transform);
+		glm::mat4x3 light_to_world = light.transform->make_local_to_world();
+
+		LightBounds bounds;
+		bounds.type = light.type;
+		bounds.position = light_to_world[3];
+		bounds.direction = glm::normalize(-light_to_world[2]);
+		bounds.distance = light.distance;
+		bounds.cos_cutoff = std::cos(0.5f * light.spot_fov);
+		bounds.sin_cutoff = std::sin(0.5f * light.spot_fov);
+		bounds.brightness = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+		light_bounds.emplace_back(bounds);
+
+		float type = 0.0f;
+		if (light.type == Light::Point) type = 0.0f;
+		else if (light.type == Light::Hemisphere) type = 1.0f;
+		else if (light.type == Light::Spot) type = 2.0f;
+		else if (light.type == Light::Directional) type = 3.0f;
+
+		//point the light at its shadow map (if it has one):
+		if (shadows && light.shadows && shadow_infos.size() < MaxShadows) {
+			if (ShadowAtlas::Map const *map = shadows->find(&light)) {
+				ShadowInfo shadow;
+				shadow.light_to_shadow = map->world_to_shadow * light_space_to_world;
+				shadow.rect = map->rect;
+				shadow_infos.emplace_back(shadow);
+				type += 4.0f * float(shadow_infos.size());
+			}
+		}
+
+		LightInfo info;
+		info.position = glm::vec4(world_to_light * glm::vec4(bounds.position, 1.0f), type);
+		info.direction = glm::vec4(glm::normalize(glm::mat3(world_to_light) * bounds.direction), bounds.cos_cutoff);
+		info.energy = glm::vec4(light.energy, light.distance);
+		light_infos.emplace_back(info);
+	}
 
+	//Describe how fragments find their cluster:
+	ClusterInfo cluster_info;
+	if (clusters) {
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		cluster_info.grid = glm::uvec4(clusters->grid, 0);
+		cluster_info.tile = glm::vec4(
+			float(clusters->grid.x) / float(std::max(1, viewport[2])),
+			float(clusters->grid.y) / float(std::max(1, viewport[3])),
+			float(viewport[0]), float(viewport[1])
+		);
+		cluster_info.depth = glm::vec4(
+			clusters->near_depth,
+			float(clusters->grid.z - 1) / std::log(clusters->far_depth / clusters->near_depth),
+			0.0f, 0.0f
+		);
+
+		glActiveTexture(GL_TEXTURE0 + ClusterRangesUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, clusters->ranges_tex);
+		glActiveTexture(GL_TEXTURE0 + ClusterIndicesUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, clusters->indices_tex);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	if (shadows) {
+		glActiveTexture(GL_TEXTURE0 + ShadowAtlasUnit);
+		glBindTexture(GL_TEXTURE_2D, shadows->texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//Upload lights and bind them for all programs:
+	constexpr size_t const ShadowsOffset = sizeof(ClusterInfo);
+	constexpr size_t const LightsOffset = ShadowsOffset + MaxShadows * sizeof(ShadowInfo);
+	if (lights_buffer == 0) glGenBuffers(1, &lights_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, LightsOffset + MaxLights * sizeof(LightInfo), nullptr, GL_STREAM_DRAW); //(orphan last frame's data)
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ClusterInfo), &cluster_info);
+	glBufferSubData(GL_UNIFORM_BUFFER, ShadowsOffset, shadow_infos.size() * sizeof(ShadowInfo), shadow_infos.data());
+	glBufferSubData(GL_UNIFORM_BUFFER, LightsOffset, light_infos.size() * sizeof(LightInfo), light_infos.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LightsBinding, lights_buffer);
+
+	//scratch space for per-drawable light lists:
+	std::vector< std::pair< float, GLint > > reaching;
+	reaching.reserve(light_bounds.size());
+	std::vector< GLint > light_indices;
+	light_indices.reserve(MaxObjectLights);
+
+	//Gather the drawables to send to OpenGL, opaque and blended:
+	std::vector< Drawable const * > to_draw, to_blend;
+	to_draw.reserve(drawables.size());
+	for (auto const &drawable : drawables) {
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (drawable.pipeline.program == 0) continue;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		if (drawable.pipeline.vao == 0) continue;
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		if (drawable.pipeline.count == 0) continue;
+
+		if (drawable.pipeline.blend) to_blend.emplace_back(&drawable);
+		else to_draw.emplace_back(&drawable);
+	}
+
+	//Sort opaque drawables nearest-first, so hidden fragments tend to fail the depth test before being shaded:
+	if (passes && passes->sort_front_to_back) {
+		sort_by_depth(world_to_clip, to_draw, false);
+	}
+	//Blended drawables must be drawn farthest-first to composite properly:
+	sort_by_depth(world_to_clip, to_blend, true);
 
+	//Send a drawable to OpenGL:
+	auto draw_drawable = [&](Drawable const &drawable) {
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
 		//Set shader program:
 		glUseProgram(pipeline.program);
@@ -134,6 +372,39 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
 		}
 
+		//LIGHT_COUNT and LIGHT_INDICES list the lights that reach this drawable:
+		// (not needed when drawing with clusters)
+		if (pipeline.LIGHT_COUNT_int != -1U && !clusters) {
+			reaching.clear();
+			glm::vec3 center;
+			float radius;
+			if (drawable.bounding_sphere(&center, &radius)) {
+				for (uint32_t l = 0; l < light_bounds.size(); ++l) {
+					LightBounds const &bounds = light_bounds[l];
+					if (!light_reaches(bounds, center, radius)) continue;
+					//rank by (rough) brightness at the drawable's center, in case there are too many:
+					glm::vec3 to_center = center - bounds.position;
+					float dis2 = (bounds.type == Light::Point || bounds.type == Light::Spot ? glm::dot(to_center, to_center) : 0.0f);
+					reaching.emplace_back(-bounds.brightness / std::max(1.0f, dis2), GLint(l));
+				}
+			} else {
+				for (uint32_t l = 0; l < light_bounds.size(); ++l) {
+					reaching.emplace_back(-light_bounds[l].brightness, GLint(l));
+				}
+			}
+			if (reaching.size() > MaxObjectLights) {
+				std::partial_sort(reaching.begin(), reaching.begin() + MaxObjectLights, reaching.end());
+				reaching.resize(MaxObjectLights);
+			}
+			light_indices.clear();
+			for (auto const &r : reaching) light_indices.emplace_back(r.second);
+
+			glUniform1i(pipeline.LIGHT_COUNT_int, GLint(light_indices.size()));
+			if (pipeline.LIGHT_INDICES_int_array != -1U && !light_indices.empty()) {
+				glUniform1iv(pipeline.LIGHT_INDICES_int_array, GLsizei(light_indices.size()), light_indices.data());
+			}
+		}
+
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
@@ -156,15 +427,114 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			}
 		}
 		glActiveTexture(GL_TEXTURE0);
+	};
+
+	GLboolean old_blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_BLEND);
+
+	if (passes && passes->depth_prepass && glIsEnabled(GL_DEPTH_TEST)) {
+		//drawables whose programs don't promise to match DepthProgram's depths (or don't read a Position attribute) can't be pre-passed:
+		std::vector< Drawable const * > prepassed, others;
+		prepassed.reserve(to_draw.size());
+		for (Drawable const *drawable : to_draw) {
+			if (drawable->pipeline.invariant_position && depth_program_for(drawable->pipeline.program)) prepassed.emplace_back(drawable);
+			else others.emplace_back(drawable);
+		}
+
+		GLint old_depth_func = GL_LESS;
+		glGetIntegerv(GL_DEPTH_FUNC, &old_depth_func);
+		GLboolean old_depth_mask = GL_TRUE;
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &old_depth_mask);
+		GLboolean old_color_mask[4] = { GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE };
+		glGetBooleanv(GL_COLOR_WRITEMASK, old_color_mask);
+
+		//depth only:
+		passes->begin(DrawPasses::Depth);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_TRUE);
+		draw_depth(world_to_clip, prepassed);
+		glColorMask(old_color_mask[0], old_color_mask[1], old_color_mask[2], old_color_mask[3]);
+		passes->end(DrawPasses::Depth);
+
+		//color, only where each drawable's depth ended up on top:
+		passes->begin(DrawPasses::Opaque);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+		for (Drawable const *drawable : prepassed) draw_drawable(*drawable);
+		glDepthFunc(GLenum(old_depth_func));
+		glDepthMask(old_depth_mask);
+		for (Drawable const *drawable : others) draw_drawable(*drawable);
+		passes->end(DrawPasses::Opaque);
+
+		passes->stats.drawables[DrawPasses::Depth] = uint32_t(prepassed.size());
+		passes->stats.drawables[DrawPasses::Opaque] = uint32_t(to_draw.size());
+	} else {
+		if (passes) passes->begin(DrawPasses::Opaque);
+		for (Drawable const *drawable : to_draw) draw_drawable(*drawable);
+		if (passes) {
+			passes->end(DrawPasses::Opaque);
+			passes->stats.drawables[DrawPasses::Depth] = 0;
+			passes->stats.drawables[DrawPasses::Opaque] = uint32_t(to_draw.size());
+		}
+	}
 
+	if (!to_blend.empty()) {
+		//blended drawables are depth tested (against the opaque ones) but don't write depth:
+		GLboolean old_depth_mask = GL_TRUE;
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &old_depth_mask);
+		GLint old_blend_func[4] = { GL_ONE, GL_ZERO, GL_ONE, GL_ZERO };
+		glGetIntegerv(GL_BLEND_SRC_RGB, &old_blend_func[0]);
+		glGetIntegerv(GL_BLEND_DST_RGB, &old_blend_func[1]);
+		glGetIntegerv(GL_BLEND_SRC_ALPHA, &old_blend_func[2]);
+		glGetIntegerv(GL_BLEND_DST_ALPHA, &old_blend_func[3]);
+
+		if (passes) passes->begin(DrawPasses::Transparent);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDepthMask(GL_FALSE);
+		for (Drawable const *drawable : to_blend) draw_drawable(*drawable);
+		glDepthMask(old_depth_mask);
+		glBlendFuncSeparate(GLenum(old_blend_func[0]), GLenum(old_blend_func[1]), GLenum(old_blend_func[2]), GLenum(old_blend_func[3]));
+		if (passes) passes->end(DrawPasses::Transparent);
 	}
+	if (passes) passes->stats.drawables[DrawPasses::Transparent] = uint32_t(to_blend.size());
+
+	if (old_blend) glEnable(GL_BLEND);
+	else glDisable(GL_BLEND);
+
+	if (passes) passes->finish();
 
 	glUseProgram(0);
 	glBindVertexArray(0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LightsBinding, 0);
+	if (clusters) {
+		glActiveTexture(GL_TEXTURE0 + ClusterRangesUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0 + ClusterIndicesUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	if (shadows) {
+		glActiveTexture(GL_TEXTURE0 + ShadowAtlasUnit);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
 
 	GL_ERRORS();
 }
 
+void Scene::replace_program(GLuint old_program, Drawable::Pipeline const &pipeline_template) {
+	for (auto &drawable : drawables) {
+		Drawable::Pipeline &pipeline = drawable.pipeline;
+		if (pipeline.program != old_program) continue;
+		pipeline.program = pipeline_template.program;
+		pipeline.OBJECT_TO_CLIP_mat4 = pipeline_template.OBJECT_TO_CLIP_mat4;
+		pipeline.OBJECT_TO_LIGHT_mat4x3 = pipeline_template.OBJECT_TO_LIGHT_mat4x3;
+		pipeline.NORMAL_TO_LIGHT_mat3 = pipeline_template.NORMAL_TO_LIGHT_mat3;
+		pipeline.LIGHT_COUNT_int = pipeline_template.LIGHT_COUNT_int;
+		pipeline.LIGHT_INDICES_int_array = pipeline_template.LIGHT_INDICES_int_array;
+	}
+}
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
@@ -299,6 +669,7 @@ void Scene::load(std::string const &filename,
 		light->type = static_cast<Light::Type>(l.type);
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
+		if (l.distance > 0.0f) light->distance = l.distance;
 	}
 
 	//load any extra that a subclass wants:
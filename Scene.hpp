@@ -15,6 +15,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <limits>
+
 #include <list>
 #include <memory>
 #include <functional>
@@ -22,6 +24,10 @@
 #include <vector>
 #include <unordered_map>
 
+struct LightClusters;
+struct ShadowAtlas;
+struct DrawPasses;
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
@@ -65,11 +71,21 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			bool blend = false; //draw (after all opaque drawables, farthest-first) with glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)?
+
+			//does the program declare 'invariant gl_Position' (computed as OBJECT_TO_CLIP * Position)?
+			// only such programs are depth pre-passed (see DrawPasses), since others may not match DepthProgram's depths exactly
+			bool invariant_position = false;
+
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
+			//lights (see LightInfo, below):
+			GLuint LIGHT_COUNT_int = -1U; //uniform location for number of lights that reach this drawable
+			GLuint LIGHT_INDICES_int_array = -1U; //uniform location for (up to MaxObjectLights) indices into the Lights block
+
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
 			//texture objects to bind for the first TextureCount textures:
@@ -79,6 +95,14 @@ struct Scene {
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
 		} pipeline;
+
+		//(optional) object-space bounding box, used to skip lights that can't reach this drawable:
+		// (when empty, as it is by default, the drawable is treated as reached by every light)
+		glm::vec3 bbox_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 bbox_max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//world-space sphere around the bounding box (returns false if there is no bounding box):
+		bool bounding_sphere(glm::vec3 *center, float *radius) const;
 	};
 
 	struct Camera {
@@ -114,7 +138,53 @@ struct Scene {
 
 		//Spotlight specific:
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
+
+		//Point/spot lights fade to nothing at this distance:
+		float distance = 40.0f;
+
+		//Spot and directional lights may cast shadows (when drawing with a ShadowAtlas):
+		bool shadows = false;
+	};
+
+	//Scene::draw sends (up to MaxLights of) 'lights' to programs in a std140 uniform block bound at LightsBinding:
+	//  struct LightInfo { vec4 position; vec4 direction; vec4 energy; };
+	//  struct ShadowInfo { mat4 light_to_shadow; vec4 rect; };
+	//  layout(std140) uniform Lights {
+	//    uvec4 CLUSTER_GRID; vec4 CLUSTER_TILE; vec4 CLUSTER_DEPTH; //see ClusterInfo
+	//    ShadowInfo SHADOWS[MaxShadows];
+	//    LightInfo LIGHTS[MaxLights];
+	//  };
+	// When drawing with LightClusters, programs find their lights through the cluster textures
+	// bound to ClusterRangesUnit and ClusterIndicesUnit (usamplerBuffers).
+	// Otherwise CLUSTER_GRID is zero, and each drawable is told which (up to MaxObjectLights) of the lights
+	// reach it through its pipeline's LIGHT_COUNT and LIGHT_INDICES uniforms.
+	// When drawing with a ShadowAtlas, its depth texture is bound to ShadowAtlasUnit (a sampler2DShadow).
+	enum : uint32_t {
+		MaxLights = 256,
+		MaxObjectLights = 8,
+		LightsBinding = 0,
+		ClusterRangesUnit = Drawable::Pipeline::TextureCount,
+		ClusterIndicesUnit = Drawable::Pipeline::TextureCount + 1,
+		MaxShadows = 16,
+		ShadowAtlasUnit = Drawable::Pipeline::TextureCount + 2,
+	};
+	struct ClusterInfo {
+		glm::uvec4 grid = glm::uvec4(0); //xyz: clusters along x, y, and depth (all zero when not using clusters)
+		glm::vec4 tile = glm::vec4(0.0f); //xy: clusters per pixel; zw: viewport origin
+		glm::vec4 depth = glm::vec4(0.0f); //x: camera near plane; y: slices per unit log(depth / near)
+	};
+	static_assert(sizeof(ClusterInfo) == 3*16, "ClusterInfo matches std140 layout.");
+	struct ShadowInfo {
+		glm::mat4 light_to_shadow; //light space to shadow map space ([0,1]^3, with z being depth)
+		glm::vec4 rect; //xy: lower left of shadow map in atlas; zw: size of shadow map in atlas
+	};
+	static_assert(sizeof(ShadowInfo) == 5*16, "ShadowInfo matches std140 layout.");
+	struct LightInfo {
+		glm::vec4 position; //xyz: position (in light space); w: type (0: point, 1: hemisphere, 2: spot, 3: directional) + 4 * (index in SHADOWS + 1)
+		glm::vec4 direction; //xyz: direction light points (in light space); w: cosine of spot cutoff angle
+		glm::vec4 energy; //xyz: energy; w: distance
 	};
+	static_assert(sizeof(LightInfo) == 3*16, "LightInfo matches std140 layout.");
 
 	//Scenes, of course, may have many of the above objects:
 	std::list< Transform > transforms;
@@ -126,7 +196,19 @@ struct Scene {
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
-	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	// (if 'clusters' is given, it must have been update()'d and upload()'d with this scene's lights;
+	//  if 'shadows' is given, it must have been update()'d with this scene;
+	//  if 'passes' is given, drawables are sorted and/or depth pre-passed as it says, and timed)
+	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f),
+		LightClusters const *clusters = nullptr, ShadowAtlas const *shadows = nullptr, DrawPasses *passes = nullptr) const;
+
+	//..or, with many lights, you might want to assign lights to clusters before drawing:
+	// (any of 'clusters', 'shadows', or 'passes' may be nullptr)
+	void draw(Camera const &camera, LightClusters *clusters, ShadowAtlas const *shadows = nullptr, DrawPasses *passes = nullptr) const;
+
+	//point drawables that use 'old_program' at the program (and uniform locations) in 'pipeline_template':
+	// (e.g., from a shader reload listener -- see ShaderWatcher.hpp)
+	void replace_program(GLuint old_program, Drawable::Pipeline const &pipeline_template);
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
@@ -0,0 +1,316 @@
+#include "ShaderWatcher.hpp"
+
+#include "gl_compile_program.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <sys/stat.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	struct Watched {
+		std::string name;
+		std::string vertex_file, fragment_file;
+		std::function< GLuint(GLuint) > swap;
+
+		bool dirty = false; //files changed since last rebuild was submitted
+		Clock::time_point changed; //when files last changed (rebuilds wait a moment, since editors often write files in several steps)
+		GLuint building = 0; //submitted program, not yet finished
+
+		int64_t vertex_mtime = 0, fragment_mtime = 0; //(for polling modification times)
+	};
+
+	struct State {
+		bool enabled = false;
+		std::string dir;
+		std::list< Watched > watched;
+		std::map< uint32_t, std::function< void(GLuint, GLuint) > > listeners;
+		uint32_t next_listener = 1;
+		Clock::time_point last_stat_check;
+		#if defined(__linux__)
+		int inotify_fd = -1;
+		#endif
+	};
+
+	State &get_state() {
+		static State state;
+		return state;
+	}
+
+	int64_t modification_time(std::string const &path) {
+		#if defined(_WIN32)
+		struct _stat64 info;
+		if (_stat64(path.c_str(), &info) != 0) return 0;
+		#else
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0) return 0;
+		#endif
+		return int64_t(info.st_mtime);
+	}
+
+	//64-bit FNV-1a, as hex (for noticing when built-in sources change):
+	std::string hash_string(std::string const &data) {
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (char c : data) {
+			h = (h ^ uint8_t(c)) * 0x100000001b3ull;
+		}
+		char str[17];
+		std::snprintf(str, sizeof(str), "%016llx", (unsigned long long)h);
+		return str;
+	}
+
+	bool read_file(std::string const &path, std::string *contents) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) return false;
+		std::ostringstream str;
+		str << file.rdbuf();
+		*contents = str.str();
+		return true;
+	}
+}
+
+void enable_shader_watching() {
+	State &state = get_state();
+	if (state.enabled) return;
+	state.enabled = true;
+
+	state.dir = data_path("shaders");
+	#if defined(_WIN32)
+	_mkdir(state.dir.c_str());
+	#else
+	mkdir(state.dir.c_str(), 0755);
+	#endif
+
+	#if defined(__linux__)
+	state.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (state.inotify_fd < 0 || inotify_add_watch(state.inotify_fd, state.dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+		std::cerr << "WARNING: couldn't watch '" << state.dir << "' with inotify; checking modification times instead." << std::endl;
+		if (state.inotify_fd >= 0) close(state.inotify_fd);
+		state.inotify_fd = -1;
+	}
+	#endif
+
+	std::cout << "Watching for shader changes in '" << state.dir << "'." << std::endl;
+}
+
+bool shader_watching_enabled() {
+	return get_state().enabled;
+}
+
+std::string shader_source(std::string const &file, std::string const &builtin) {
+	State &state = get_state();
+	if (!state.enabled) return builtin;
+
+	//'file.builtin' holds the hash of the built-in source 'file' was written from:
+	std::string path = state.dir + "/" + file;
+	std::string hash_path = path + ".builtin";
+	std::string builtin_hash = hash_string(builtin);
+
+	std::string contents, stored_hash;
+	if (read_file(path, &contents)) {
+		read_file(hash_path, &stored_hash);
+		if (stored_hash == builtin_hash) return contents;
+
+		//the built-in source has changed since the file was written (or the file came from elsewhere):
+		if (hash_string(contents) != stored_hash) {
+			//...and the file was edited, so keep the edits around but switch to the new source:
+			std::string old_path = path + ".old";
+			std::remove(old_path.c_str());
+			if (std::rename(path.c_str(), old_path.c_str()) == 0) {
+				std::cerr << "WARNING: built-in source for '" << file << "' has changed since '" << path << "' was written;"
+					" moved your version to '" << old_path << "' and using the new built-in source." << std::endl;
+			} else {
+				std::cerr << "WARNING: built-in source for '" << file << "' has changed since '" << path << "' was written;"
+					" delete it (or update '" << hash_path << "') to stop seeing this. Using the file anyway." << std::endl;
+				return contents;
+			}
+		}
+	}
+
+	//write out the built-in source to have something to edit:
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << builtin;
+		if (!out) {
+			std::cerr << "WARNING: failed to write shader source to '" << path << "'." << std::endl;
+		}
+	}
+	{
+		std::ofstream out(hash_path, std::ios::binary);
+		out << builtin_hash;
+	}
+	return builtin;
+}
+
+void watch_shader_program(
+	std::string const &name,
+	std::string const &vertex_file,
+	std::string const &fragment_file,
+	std::function< GLuint(GLuint new_program) > const &swap) {
+
+	State &state = get_state();
+	if (!state.enabled) return;
+
+	state.watched.emplace_back();
+	Watched &watched = state.watched.back();
+	watched.name = name;
+	watched.vertex_file = vertex_file;
+	watched.fragment_file = fragment_file;
+	watched.swap = swap;
+	watched.vertex_mtime = modification_time(state.dir + "/" + vertex_file);
+	watched.fragment_mtime = modification_time(state.dir + "/" + fragment_file);
+}
+
+bool same_attribute_locations(GLuint a, GLuint b) {
+	auto attributes = [](GLuint program) {
+		std::map< std::string, GLint > ret;
+		GLint count = 0, max_length = 0;
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+		std::vector< GLchar > name(std::max(max_length, 1), '\0');
+		for (GLint i = 0; i < count; ++i) {
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = GL_NONE;
+			glGetActiveAttrib(program, GLuint(i), GLsizei(name.size()), &length, &size, &type, name.data());
+			std::string attribute(name.data(), length);
+			ret.emplace(attribute, glGetAttribLocation(program, attribute.c_str()));
+		}
+		return ret;
+	};
+	std::map< std::string, GLint > attributes_a = attributes(a);
+	std::map< std::string, GLint > attributes_b = attributes(b);
+	//(attributes only one program uses don't matter, since the other won't read them)
+	for (auto const &[attribute, location] : attributes_a) {
+		auto f = attributes_b.find(attribute);
+		if (f != attributes_b.end() && f->second != location) return false;
+	}
+	return true;
+}
+
+void unwatch_shader_program(std::string const &name) {
+	State &state = get_state();
+	for (auto w = state.watched.begin(); w != state.watched.end(); ) {
+		auto old = w;
+		++w;
+		if (old->name != name) continue;
+		if (old->building) {
+			//(finish before deleting, so nothing is left pending in gl_compile_program)
+			try {
+				gl_finish_program(old->building);
+				glDeleteProgram(old->building);
+			} catch (std::exception &) {
+			}
+		}
+		state.watched.erase(old);
+	}
+}
+
+uint32_t add_shader_reload_listener(std::function< void(GLuint old_program, GLuint new_program) > const &fn) {
+	State &state = get_state();
+	uint32_t id = state.next_listener++;
+	state.listeners.emplace(id, fn);
+	return id;
+}
+
+void remove_shader_reload_listener(uint32_t id) {
+	get_state().listeners.erase(id);
+}
+
+void poll_shader_watcher() {
+	State &state = get_state();
+	if (!state.enabled || state.watched.empty()) return;
+
+	Clock::time_point now = Clock::now();
+
+	//(1) notice changed files:
+	auto mark = [&](std::string const &file) {
+		for (auto &watched : state.watched) {
+			if (file == watched.vertex_file || file == watched.fragment_file) {
+				watched.dirty = true;
+				watched.changed = now;
+			}
+		}
+	};
+
+	#if defined(__linux__)
+	if (state.inotify_fd >= 0) {
+		alignas(struct inotify_event) char buffer[4096];
+		while (true) {
+			ssize_t got = read(state.inotify_fd, buffer, sizeof(buffer));
+			if (got <= 0) break; //(EAGAIN == no more events)
+			for (char *ptr = buffer; ptr < buffer + got; ) {
+				struct inotify_event const *event = reinterpret_cast< struct inotify_event const * >(ptr);
+				if (event->len > 0) mark(event->name);
+				ptr += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	} else
+	#endif
+	if (now - state.last_stat_check > std::chrono::milliseconds(250)) {
+		state.last_stat_check = now;
+		for (auto &watched : state.watched) {
+			int64_t vertex_mtime = modification_time(state.dir + "/" + watched.vertex_file);
+			int64_t fragment_mtime = modification_time(state.dir + "/" + watched.fragment_file);
+			if (vertex_mtime != watched.vertex_mtime || fragment_mtime != watched.fragment_mtime) {
+				watched.vertex_mtime = vertex_mtime;
+				watched.fragment_mtime = fragment_mtime;
+				watched.dirty = true;
+				watched.changed = now;
+			}
+		}
+	}
+
+	for (auto &watched : state.watched) {
+		//(2) submit rebuilds for programs whose files have settled:
+		if (watched.dirty && watched.building == 0 && now - watched.changed > std::chrono::milliseconds(100)) {
+			watched.dirty = false;
+			std::string vertex_source, fragment_source;
+			if (!read_file(state.dir + "/" + watched.vertex_file, &vertex_source)
+			 || !read_file(state.dir + "/" + watched.fragment_file, &fragment_source)) {
+				std::cerr << "WARNING: couldn't read shader sources for '" << watched.name << "'; keeping the current program." << std::endl;
+				continue;
+			}
+			std::cout << "Rebuilding '" << watched.name << "'..." << std::endl;
+			watched.building = gl_submit_program(watched.name, vertex_source, fragment_source);
+		}
+
+		//(3) swap in finished rebuilds:
+		if (watched.building != 0 && gl_program_ready(watched.building)) {
+			GLuint program = watched.building;
+			watched.building = 0;
+			try {
+				gl_finish_program(program);
+			} catch (std::exception &e) {
+				std::cerr << "WARNING: " << e.what() << " Keeping the current program." << std::endl;
+				continue;
+			}
+			GLuint old_program = watched.swap(program);
+			for (auto const &listener : state.listeners) {
+				listener.second(old_program, program);
+			}
+			if (old_program) glDeleteProgram(old_program);
+		}
+	}
+}
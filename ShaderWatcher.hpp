@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * Shader hot-reloading (turn on with --watch-shaders):
+ *
+ * Programs that get their sources through shader_source() read them from data_path("shaders/")
+ * (the built-in sources are written there the first time, to have something to edit; if the built-in
+ *  source later changes, the file is replaced -- and any edited version kept as '<file>.old' -- with a warning).
+ * Programs registered with watch_shader_program() are rebuilt when those files change:
+ *  - changes are noticed with inotify on Linux (and by checking modification times elsewhere)
+ *  - the rebuild is submitted with gl_submit_program and swapped in on a later frame once it's done,
+ *    so compiling doesn't stall the game (with KHR_parallel_shader_compile, anyway)
+ *  - if the new sources don't compile, errors are printed and the old program stays in use
+ *
+ */
+
+#include "GL.hpp"
+#include "Load.hpp"
+
+#include <functional>
+#include <iostream>
+#include <string>
+
+//call before call_load_functions() to turn on hot-reloading:
+void enable_shader_watching();
+bool shader_watching_enabled();
+
+//returns the source to use for shader 'file' (e.g., "LitColorTextureProgram.vert"):
+// 'builtin' unless hot-reloading is on, in which case the file's contents
+std::string shader_source(std::string const &file, std::string const &builtin);
+
+//rebuild program 'name' from files 'vertex_file' and 'fragment_file' when they change (does nothing if not enabled):
+// 'swap' is called (from poll_shader_watcher) with the new, successfully-linked program; it should switch everything
+// over to the new program and return the old one, which is deleted after any reload listeners are called.
+void watch_shader_program(
+	std::string const &name,
+	std::string const &vertex_file,
+	std::string const &fragment_file,
+	std::function< GLuint(GLuint new_program) > const &swap);
+
+//watch_shader_program for a program struct loaded with Load<> (e.g., LitColorTextureProgram):
+// on reload, a new PROGRAM is made from the new program (PROGRAM(GLuint) looks up locations), put in 'load',
+// and passed to 'on_swap' (e.g., to update a pipeline template); the old PROGRAM is then deleted (but not its program,
+// which the watcher deletes once any reload listeners have seen it).
+template< typename PROGRAM >
+void watch_shader_program(
+	Load< PROGRAM > &load,
+	std::string const &name,
+	std::string const &vertex_file,
+	std::string const &fragment_file,
+	void (*on_swap)(PROGRAM const *));
+
+//do programs 'a' and 'b' put their active attributes at the same locations?
+// (if not, vertex arrays made for one won't work with the other)
+bool same_attribute_locations(GLuint a, GLuint b);
+
+//stop watching program 'name' (e.g., when whatever 'swap' refers to is going away):
+void unwatch_shader_program(std::string const &name);
+
+//called after a program is swapped (e.g., so modes can update Scene drawables that copied a Pipeline template):
+// returns an id for remove_shader_reload_listener
+uint32_t add_shader_reload_listener(std::function< void(GLuint old_program, GLuint new_program) > const &fn);
+void remove_shader_reload_listener(uint32_t id);
+
+//call once per frame: notices changed files, submits rebuilds, and swaps in the ones that are finished:
+void poll_shader_watcher();
+
+//------------------------------
+
+template< typename PROGRAM >
+void watch_shader_program(
+	Load< PROGRAM > &load,
+	std::string const &name,
+	std::string const &vertex_file,
+	std::string const &fragment_file,
+	void (*on_swap)(PROGRAM const *)) {
+	watch_shader_program(name, vertex_file, fragment_file, [&load, name, on_swap](GLuint new_program) -> GLuint {
+		PROGRAM const *old = load.value;
+		if (!same_attribute_locations(old->program, new_program)) {
+			std::cerr << "WARNING: " << name << " attribute locations changed; vertex arrays made for the old program won't match." << std::endl;
+		}
+
+		//swap over the program object (and whatever on_swap updates) together:
+		PROGRAM *next = new PROGRAM(new_program);
+		load.value = next;
+		if (on_swap) on_swap(next);
+
+		//(PROGRAM's destructor deletes its program, so take that back first)
+		GLuint old_program = old->program;
+		const_cast< PROGRAM * >(old)->program = 0;
+		delete old;
+		return old_program;
+	});
+}
@@ -0,0 +1,310 @@
+#include "ShadowAtlas.hpp"
+
+#include "DepthProgram.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	//FNV-1a, for noticing when anything a shadow map depends on has changed:
+	struct Signature {
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		void add(void const *data, size_t bytes) {
+			uint8_t const *at = reinterpret_cast< uint8_t const * >(data);
+			for (size_t i = 0; i < bytes; ++i) {
+				hash = (hash ^ at[i]) * 0x100000001b3ULL;
+			}
+		}
+		template< typename T >
+		void add(T const &value) { add(&value, sizeof(value)); }
+	};
+
+	//is a (world-space) sphere at least partly inside the frustum of 'world_to_clip'?
+	bool sphere_in_frustum(glm::mat4 const &world_to_clip, glm::vec3 const &center, float radius) {
+		glm::vec4 row[4];
+		for (int r = 0; r < 4; ++r) {
+			row[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+		}
+		glm::vec4 const planes[6] = {
+			row[3] + row[0], row[3] - row[0],
+			row[3] + row[1], row[3] - row[1],
+			row[3] + row[2], row[3] - row[2],
+		};
+		for (auto const &plane : planes) {
+			glm::vec3 normal = glm::vec3(plane);
+			float distance = glm::dot(normal, center) + plane.w;
+			if (distance < -radius * glm::length(normal)) return false;
+		}
+		return true;
+	}
+
+	//world-to-light "view" matrix (ignores any scale in the light's transform):
+	glm::mat4 make_light_view(Scene::Light const &light) {
+		glm::mat4x3 light_to_world = light.transform->make_local_to_world();
+		glm::vec3 x = glm::normalize(light_to_world[0]);
+		glm::vec3 y = glm::normalize(light_to_world[1]);
+		glm::vec3 z = glm::normalize(light_to_world[2]);
+		glm::vec3 p = light_to_world[3];
+		return glm::mat4(
+			glm::vec4(x.x, y.x, z.x, 0.0f),
+			glm::vec4(x.y, y.y, z.y, 0.0f),
+			glm::vec4(x.z, y.z, z.z, 0.0f),
+			glm::vec4(-glm::dot(x, p), -glm::dot(y, p), -glm::dot(z, p), 1.0f)
+		);
+	}
+}
+
+ShadowAtlas::ShadowAtlas(uint32_t size_, uint32_t map_size_) : size(size_), map_size(map_size_) {
+	if (map_size == 0 || size < map_size || size % map_size != 0) {
+		throw std::runtime_error("Shadow atlas size (" + std::to_string(size) + ") must be a multiple of map size (" + std::to_string(map_size) + ").");
+	}
+
+	//lay out maps in a grid:
+	uint32_t per_row = size / map_size;
+	for (uint32_t y = 0; y < per_row; ++y) {
+		for (uint32_t x = 0; x < per_row; ++x) {
+			if (maps.size() == Scene::MaxShadows) break;
+			maps.emplace_back();
+			Map &map = maps.back();
+			map.origin = glm::uvec2(x * map_size, y * map_size);
+			map.rect = glm::vec4(
+				float(map.origin.x) / float(size), float(map.origin.y) / float(size),
+				float(map_size) / float(size), float(map_size) / float(size)
+			);
+		}
+	}
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, GLsizei(size), GLsizei(size), 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	//linear filtering + comparison gives 2x2 percentage-closer filtering for free:
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint old_draw_framebuffer = 0, old_read_framebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_draw_framebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &old_read_framebuffer);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(old_draw_framebuffer));
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(old_read_framebuffer));
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		throw std::runtime_error("Shadow atlas framebuffer is incomplete (status " + std::to_string(status) + ").");
+	}
+
+	GL_ERRORS();
+}
+
+ShadowAtlas::~ShadowAtlas() {
+	glDeleteFramebuffers(1, &framebuffer);
+	framebuffer = 0;
+	glDeleteTextures(1, &texture);
+	texture = 0;
+}
+
+ShadowAtlas::Map const *ShadowAtlas::find(Scene::Light const *light) const {
+	for (auto const &map : maps) {
+		if (map.light == light) return (map.rendered ? &map : nullptr);
+	}
+	return nullptr;
+}
+
+void ShadowAtlas::update(Scene const &scene) {
+	stats = Stats();
+
+	//(1) find lights that want shadow maps:
+	std::vector< Scene::Light const * > casting;
+	for (auto const &light : scene.lights) {
+		if (!light.shadows) continue;
+		if (light.type != Scene::Light::Spot && light.type != Scene::Light::Directional) continue;
+		if (casting.size() == maps.size()) {
+			static bool warned = false;
+			if (!warned) {
+				std::cerr << "WARNING: more than " << maps.size() << " shadow-casting lights; ignoring the rest." << std::endl;
+				warned = true;
+			}
+			break;
+		}
+		casting.emplace_back(&light);
+	}
+
+	//(2) lights keep their maps from frame to frame; maps of lights that stopped casting are freed:
+	for (auto &map : maps) {
+		if (map.light && std::find(casting.begin(), casting.end(), map.light) == casting.end()) {
+			map.light = nullptr;
+			map.rendered = false;
+		}
+	}
+	for (Scene::Light const *light : casting) {
+		bool found = false;
+		for (auto const &map : maps) found = found || map.light == light;
+		if (found) continue;
+		for (auto &map : maps) {
+			if (map.light == nullptr) {
+				map.light = light;
+				map.rendered = false;
+				break;
+			}
+		}
+	}
+
+	//(3) gather casters:
+	struct Caster {
+		Scene::Drawable const *drawable;
+		glm::mat4x3 object_to_world;
+		glm::vec3 center;
+		float radius;
+		bool bounded;
+	};
+	std::vector< Caster > casters;
+	casters.reserve(scene.drawables.size());
+	for (auto const &drawable : scene.drawables) {
+		if (drawable.pipeline.program == 0 || drawable.pipeline.vao == 0 || drawable.pipeline.count == 0) continue;
+		Caster caster;
+		caster.drawable = &drawable;
+		caster.object_to_world = drawable.transform->make_local_to_world();
+		caster.bounded = drawable.bounding_sphere(&caster.center, &caster.radius);
+		casters.emplace_back(caster);
+	}
+
+	//(4) figure out which maps need re-rendering:
+	struct Pending {
+		Map *map;
+		glm::mat4 world_to_clip;
+		std::vector< Scene::Drawable const * > drawables;
+	};
+	std::vector< Pending > pending;
+
+	for (auto &map : maps) {
+		if (!map.light) continue;
+		Scene::Light const &light = *map.light;
+		stats.maps += 1;
+
+		glm::mat4 view = make_light_view(light);
+		glm::mat4 world_to_clip;
+		if (light.type == Scene::Light::Spot) {
+			float near_plane = std::max(0.01f, 0.001f * light.distance);
+			world_to_clip = glm::perspective(light.spot_fov, 1.0f, near_plane, light.distance) * view;
+		} else {
+			//fit an orthographic projection around every bounded caster:
+			glm::vec3 lo = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 hi = glm::vec3(-std::numeric_limits< float >::infinity());
+			for (auto const &caster : casters) {
+				if (!caster.bounded) continue;
+				glm::vec3 center = view * glm::vec4(caster.center, 1.0f);
+				lo = glm::min(lo, center - glm::vec3(caster.radius));
+				hi = glm::max(hi, center + glm::vec3(caster.radius));
+			}
+			if (!(lo.x <= hi.x)) {
+				map.rendered = false; //nothing to cast shadows
+				continue;
+			}
+			//(light looks down -z, so near/far planes are at -hi.z and -lo.z)
+			world_to_clip = glm::ortho(lo.x, hi.x, lo.y, hi.y, -hi.z, -lo.z) * view;
+		}
+
+		//casters that can show up in the map:
+		Pending todo;
+		todo.map = &map;
+		todo.world_to_clip = world_to_clip;
+		Signature signature;
+		signature.add(world_to_clip);
+		for (auto const &caster : casters) {
+			if (caster.bounded && !sphere_in_frustum(world_to_clip, caster.center, caster.radius)) continue;
+			todo.drawables.emplace_back(caster.drawable);
+			Scene::Drawable::Pipeline const &pipeline = caster.drawable->pipeline;
+			signature.add(caster.drawable);
+			signature.add(caster.object_to_world);
+			signature.add(pipeline.vao);
+			signature.add(pipeline.type);
+			signature.add(pipeline.start);
+			signature.add(pipeline.count);
+		}
+
+		//(static lights + static casters == same signature == no need to redraw)
+		if (map.rendered && map.signature == signature.hash) {
+			stats.reused += 1;
+			continue;
+		}
+
+		//shadow map space: clip space [-1,1]^3 => [0,1]^3
+		glm::mat4 clip_to_shadow = glm::mat4(
+			glm::vec4(0.5f, 0.0f, 0.0f, 0.0f),
+			glm::vec4(0.0f, 0.5f, 0.0f, 0.0f),
+			glm::vec4(0.0f, 0.0f, 0.5f, 0.0f),
+			glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)
+		);
+		map.world_to_shadow = clip_to_shadow * world_to_clip;
+		map.signature = signature.hash;
+		map.rendered = true;
+		pending.emplace_back(std::move(todo));
+	}
+
+	if (pending.empty()) return;
+
+	//(5) render maps that need it:
+	GLint old_draw_framebuffer = 0, old_read_framebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_draw_framebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &old_read_framebuffer);
+	GLint old_viewport[4];
+	glGetIntegerv(GL_VIEWPORT, old_viewport);
+	GLboolean old_depth_test = glIsEnabled(GL_DEPTH_TEST);
+	GLint old_depth_func = GL_LESS;
+	glGetIntegerv(GL_DEPTH_FUNC, &old_depth_func);
+	GLboolean old_depth_mask = GL_TRUE;
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &old_depth_mask);
+	GLboolean old_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+	GLint old_scissor[4];
+	glGetIntegerv(GL_SCISSOR_BOX, old_scissor);
+	GLboolean old_polygon_offset_fill = glIsEnabled(GL_POLYGON_OFFSET_FILL);
+	GLfloat old_polygon_offset_factor = 0.0f, old_polygon_offset_units = 0.0f;
+	glGetFloatv(GL_POLYGON_OFFSET_FACTOR, &old_polygon_offset_factor);
+	glGetFloatv(GL_POLYGON_OFFSET_UNITS, &old_polygon_offset_units);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_SCISSOR_TEST);
+	//slope-scaled bias keeps surfaces from shadowing themselves ("shadow acne"):
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+
+	for (auto const &todo : pending) {
+		glViewport(GLint(todo.map->origin.x), GLint(todo.map->origin.y), GLsizei(map_size), GLsizei(map_size));
+		glScissor(GLint(todo.map->origin.x), GLint(todo.map->origin.y), GLsizei(map_size), GLsizei(map_size));
+		glClear(GL_DEPTH_BUFFER_BIT);
+		draw_depth(todo.world_to_clip, todo.drawables);
+		stats.rendered += 1;
+		stats.casters += uint32_t(todo.drawables.size());
+	}
+
+	glPolygonOffset(old_polygon_offset_factor, old_polygon_offset_units);
+	if (!old_polygon_offset_fill) glDisable(GL_POLYGON_OFFSET_FILL);
+	glScissor(old_scissor[0], old_scissor[1], old_scissor[2], old_scissor[3]);
+	if (!old_scissor_test) glDisable(GL_SCISSOR_TEST);
+	glDepthMask(old_depth_mask);
+	glDepthFunc(GLenum(old_depth_func));
+	if (!old_depth_test) glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(old_draw_framebuffer));
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(old_read_framebuffer));
+	glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+
+	GL_ERRORS();
+}
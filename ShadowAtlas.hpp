@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * ShadowAtlas keeps shadow maps for a Scene's shadow-casting (Light::shadows) spot and directional lights
+ * as square tiles of one big depth texture:
+ *  - spot lights get a perspective shadow map covering their cone, out to Light::distance
+ *  - directional lights get an orthographic shadow map fit around all (bounded) drawables
+ *  - update() only re-renders a shadow map when its light or one of the drawables it can see
+ *    has moved (or changed vertex ranges), so static lights cost nothing after the first frame
+ * (point lights would need six maps each, so they don't cast shadows)
+ *
+ * Pass the atlas to Scene::draw to have LitColorTextureProgram sample it.
+ *
+ */
+
+#include "Scene.hpp"
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct ShadowAtlas {
+	//'size' x 'size' atlas holding ('size' / 'map_size')^2 shadow maps (at most Scene::MaxShadows):
+	ShadowAtlas(uint32_t size = 4096, uint32_t map_size = 1024);
+	~ShadowAtlas();
+
+	ShadowAtlas(ShadowAtlas const &) = delete;
+	ShadowAtlas &operator=(ShadowAtlas const &) = delete;
+
+	//(re-)render the shadow maps of 'scene''s shadow-casting lights that need it:
+	// (restores framebuffer, viewport, depth, scissor, and polygon offset state afterward)
+	void update(Scene const &scene);
+
+	struct Map {
+		Scene::Light const *light = nullptr; //light using this map (nullptr if free)
+		glm::uvec2 origin = glm::uvec2(0); //lower left of map in atlas (pixels)
+		glm::mat4 world_to_shadow = glm::mat4(1.0f); //world space to map space ([0,1]^3, z being depth)
+		glm::vec4 rect = glm::vec4(0.0f); //xy: origin, zw: size of map, as fractions of the atlas
+		uint64_t signature = 0; //hash of light and visible casters when last rendered
+		bool rendered = false; //does the map hold a valid image?
+	};
+
+	//shadow map for 'light' (nullptr if it doesn't have a valid one):
+	Map const *find(Scene::Light const *light) const;
+
+	uint32_t const size;
+	uint32_t const map_size;
+	std::vector< Map > maps;
+
+	GLuint texture = 0; //GL_DEPTH_COMPONENT24, set up for sampler2DShadow lookups
+	GLuint framebuffer = 0;
+
+	struct Stats {
+		uint32_t maps = 0; //maps in use
+		uint32_t rendered = 0; //maps re-rendered by the last update()
+		uint32_t reused = 0; //maps left as-is by the last update()
+		uint32_t casters = 0; //drawables drawn into re-rendered maps
+	} stats;
+};
@@ -0,0 +1,55 @@
+#include "ShapeCache.hpp"
+
+ShapeCache::ShapeCache(hb_font_t *hb_font_, uint32_t font_size_, size_t capacity_)
+	: hb_font(hb_font_), font_size(font_size_), capacity(capacity_) {
+	hb_buffer = hb_buffer_create();
+}
+
+ShapeCache::~ShapeCache() {
+	hb_buffer_destroy(hb_buffer);
+	hb_buffer = nullptr;
+}
+
+std::shared_ptr< ShapeCache::Run const > ShapeCache::shape(std::string const &text) {
+	Key key{text, font_size};
+
+	{ //already shaped? move to front and return:
+		auto f = lookup.find(key);
+		if (f != lookup.end()) {
+			runs.splice(runs.begin(), runs, f->second);
+			return f->second->second;
+		}
+	}
+
+	//shape the text:
+	// https://github.com/harfbuzz/harfbuzz-tutorial/blob/master/hello-harfbuzz-freetype.c
+	hb_buffer_reset(hb_buffer);
+	hb_buffer_add_utf8(hb_buffer, text.c_str(), int(text.size()), 0, int(text.size()));
+	hb_buffer_guess_segment_properties(hb_buffer);
+	hb_shape(hb_font, hb_buffer, nullptr, 0);
+
+	unsigned int len = hb_buffer_get_length(hb_buffer);
+	hb_glyph_info_t *info = hb_buffer_get_glyph_infos(hb_buffer, nullptr);
+	hb_glyph_position_t *pos = hb_buffer_get_glyph_positions(hb_buffer, nullptr);
+
+	std::shared_ptr< Run > run = std::make_shared< Run >();
+	run->glyphs.reserve(len);
+	for (unsigned int i = 0; i < len; ++i) {
+		run->glyphs.emplace_back(Glyph{
+			info[i].codepoint,
+			info[i].cluster,
+			pos[i].x_advance, pos[i].y_advance,
+			pos[i].x_offset, pos[i].y_offset
+		});
+	}
+
+	//remember it, dropping the least-recently-used run if over capacity:
+	runs.emplace_front(key, run);
+	lookup.emplace(key, runs.begin());
+	while (runs.size() > capacity) {
+		lookup.erase(runs.back().first);
+		runs.pop_back();
+	}
+
+	return run;
+}
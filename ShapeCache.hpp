@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * ShapeCache remembers the result of shaping strings with HarfBuzz,
+ * so that text which is drawn every frame only gets shaped once.
+ *
+ * Least-recently-used runs are dropped once more than 'capacity' are cached.
+ *
+ */
+
+#include <hb.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ShapeCache {
+	//font_size is the (pixel) size hb_font was set up for; it is part of the cache key:
+	ShapeCache(hb_font_t *hb_font, uint32_t font_size, size_t capacity = 256);
+	~ShapeCache();
+
+	ShapeCache(ShapeCache const &) = delete;
+	ShapeCache &operator=(ShapeCache const &) = delete;
+
+	struct Glyph {
+		uint32_t index; //glyph index in font
+		uint32_t cluster; //byte offset in the source string of the character(s) this glyph came from
+		int32_t x_advance, y_advance; //(26.6 fixed point, as in hb_glyph_position_t)
+		int32_t x_offset, y_offset;
+	};
+	struct Run {
+		std::vector< Glyph > glyphs;
+	};
+
+	//get the shaped run for a string (shaping it if not already cached):
+	// (runs are shared, so they stay valid even after being dropped from the cache)
+	std::shared_ptr< Run const > shape(std::string const &text);
+
+	//---- internals ----
+	hb_font_t *hb_font;
+	uint32_t font_size;
+	size_t capacity;
+
+	struct Key {
+		std::string text;
+		uint32_t font_size;
+		bool operator==(Key const &o) const { return font_size == o.font_size && text == o.text; }
+	};
+	struct KeyHash {
+		size_t operator()(Key const &key) const { return std::hash< std::string >()(key.text) ^ (size_t(key.font_size) * 0x9e3779b9u); }
+	};
+
+	//most-recently-used runs at the front:
+	std::list< std::pair< Key, std::shared_ptr< Run const > > > runs;
+	std::unordered_map< Key, decltype(runs)::iterator, KeyHash > lookup;
+
+	hb_buffer_t *hb_buffer = nullptr; //re-used for each shaping call
+};
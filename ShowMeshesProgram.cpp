@@ -5,6 +5,60 @@
 
 Scene::Drawable::Pipeline show_meshes_program_pipeline;
 
+static SubmittedProgram submitted_program("ShowMeshesProgram",
+	//vertex shader:
+	"#version 330\n"
+	"uniform mat4 OBJECT_TO_CLIP;\n"
+	"uniform mat4x3 OBJECT_TO_LIGHT;\n"
+	"uniform mat3 NORMAL_TO_LIGHT;\n"
+	"in vec4 Position;\n"
+	"in vec3 Normal;\n"
+	"in vec4 Color;\n"
+	"in vec2 TexCoord;\n"
+	"out vec3 position;\n"
+	"out vec3 normal;\n"
+	"out vec4 color;\n"
+	"out vec2 texCoord;\n"
+	"void main() {\n"
+	"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+	"	position = OBJECT_TO_LIGHT * Position;\n"
+	"	normal = NORMAL_TO_LIGHT * Normal;\n"
+	"	color = Color;\n"
+	"	texCoord = TexCoord;\n"
+	"}\n"
+,
+	//fragment shader:
+	"#version 330\n"
+	"uniform int INSPECT_MODE;\n"
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in vec4 color;\n"
+	"in vec2 texCoord;\n"
+	"out vec4 fragColor;\n"
+	"vec3 grid(vec3 p) {\n"
+	"	vec3 ret;\n"
+	"	ret.x = fract(p.x);\n"
+	"	ret.y = fract(p.y);\n"
+	"	ret.z = fract(p.z);\n"
+	"	return ret;\n"
+	"}\n"
+	"void main() {\n"
+	"	vec3 n = normalize(normal);\n"
+	"	if (INSPECT_MODE == 1) {\n"
+	"		fragColor = vec4(grid(position), 1.0);\n"
+	"	} else if (INSPECT_MODE == 2) {\n"
+	"		fragColor = vec4((0.5 * n) + 0.5, 1.0);\n"
+	"	} else if (INSPECT_MODE == 3) {\n"
+	"		fragColor = color;\n"
+	"	} else if (INSPECT_MODE == 4) {\n"
+	"		fragColor = vec4(grid(vec3(texCoord,0.0)), 1.0);\n"
+	"	} else {\n"
+	"		vec3 l = vec3(0.0,0.0,1.0);\n"
+	"		fragColor = vec4(mix(vec3(0.5), vec3(1.0), 0.5 * dot(n,l) + 0.5) * color.rgb, color.a);\n"
+	"	}\n"
+	"}\n"
+);
+
 Load< ShowMeshesProgram > show_meshes_program(LoadTagEarly, []() -> ShowMeshesProgram * {
 	auto *ret = new ShowMeshesProgram();
 
@@ -18,60 +72,8 @@ Load< ShowMeshesProgram > show_meshes_program(LoadTagEarly, []() -> ShowMeshesPr
 });
 
 ShowMeshesProgram::ShowMeshesProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
-		"out vec3 position;\n"
-		"out vec3 normal;\n"
-		"out vec4 color;\n"
-		"out vec2 texCoord;\n"
-		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
-		"	color = Color;\n"
-		"	texCoord = TexCoord;\n"
-		"}\n"
-	,
-		//fragment shader:
-		"#version 330\n"
-		"uniform int INSPECT_MODE;\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
-		"vec3 grid(vec3 p) {\n"
-		"	vec3 ret;\n"
-		"	ret.x = fract(p.x);\n"
-		"	ret.y = fract(p.y);\n"
-		"	ret.z = fract(p.z);\n"
-		"	return ret;\n"
-		"}\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	if (INSPECT_MODE == 1) {\n"
-		"		fragColor = vec4(grid(position), 1.0);\n"
-		"	} else if (INSPECT_MODE == 2) {\n"
-		"		fragColor = vec4((0.5 * n) + 0.5, 1.0);\n"
-		"	} else if (INSPECT_MODE == 3) {\n"
-		"		fragColor = color;\n"
-		"	} else if (INSPECT_MODE == 4) {\n"
-		"		fragColor = vec4(grid(vec3(texCoord,0.0)), 1.0);\n"
-		"	} else {\n"
-		"		vec3 l = vec3(0.0,0.0,1.0);\n"
-		"		fragColor = vec4(mix(vec3(0.5), vec3(1.0), 0.5 * dot(n,l) + 0.5) * color.rgb, color.a);\n"
-		"	}\n"
-		"}\n"
-	);
+	//wait for the program submitted above to finish compiling (throws on errors):
+	program = submitted_program.finish();
 
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
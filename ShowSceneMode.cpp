@@ -72,6 +72,19 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 	return false;
 }
 
+void ShowSceneMode::update(float elapsed) {
+	if (!passes) return;
+	report_elapsed += elapsed;
+	if (report_elapsed < 1.0f) return;
+	report_elapsed = 0.0f;
+
+	DrawPasses::Stats const &stats = passes->stats;
+	std::cout << "GPU time: depth pre-pass " << stats.gpu_ms[DrawPasses::Depth] << " ms (" << stats.drawables[DrawPasses::Depth] << " drawables), "
+		<< "opaque " << stats.gpu_ms[DrawPasses::Opaque] << " ms (" << stats.drawables[DrawPasses::Opaque] << "), "
+		<< "transparent " << stats.gpu_ms[DrawPasses::Transparent] << " ms (" << stats.drawables[DrawPasses::Transparent] << "); "
+		<< stats.frames_behind << " frames behind." << std::endl;
+}
+
 void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
@@ -91,7 +104,12 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 
-	scene.draw(*scene_camera);
+	if (shadows) shadows->update(scene);
+	if (shadows || passes) {
+		scene.draw(*scene_camera, nullptr, shadows.get(), passes.get());
+	} else {
+		scene.draw(*scene_camera);
+	}
 
 	{ //decorate with some lines:
 		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
@@ -10,12 +10,17 @@
 #include "Mode.hpp"
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "ShadowAtlas.hpp"
+#include "DrawPasses.hpp"
+
+#include <memory>
 
 struct ShowSceneMode : Mode {
 	ShowSceneMode(Scene const &scene);
 	virtual ~ShowSceneMode();
 
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
+	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
 	//z-up trackball-style camera controls:
@@ -30,6 +35,13 @@ struct ShowSceneMode : Mode {
 	//Scene being viewed:
 	Scene const &scene;
 
+	//(optional) shadow maps for the scene's shadow-casting lights (only LitColorTextureProgram uses them):
+	std::unique_ptr< ShadowAtlas > shadows;
+
+	//(optional) depth pre-pass / sorting settings; per-pass GPU times are printed about once a second:
+	std::unique_ptr< DrawPasses > passes;
+	float report_elapsed = 0.0f;
+
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
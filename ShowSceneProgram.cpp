@@ -1,77 +1,94 @@
 #include "ShowSceneProgram.hpp"
 
+#include "ShaderWatcher.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
 Scene::Drawable::Pipeline show_scene_program_pipeline;
 
-Load< ShowSceneProgram > show_scene_program(LoadTagEarly, []() -> ShowSceneProgram * {
-	auto *ret = new ShowSceneProgram();
+//built-in shader sources (when hot-reloading is on, these are read from files instead; see ShaderWatcher.hpp):
+static std::string const vertex_source =
+	"#version 330\n"
+	"uniform mat4 OBJECT_TO_CLIP;\n"
+	"uniform mat4x3 OBJECT_TO_LIGHT;\n"
+	"uniform mat3 NORMAL_TO_LIGHT;\n"
+	"in vec4 Position;\n"
+	"in vec3 Normal;\n"
+	"in vec4 Color;\n"
+	"in vec2 TexCoord;\n"
+	"invariant gl_Position;\n" //(matches DepthProgram, for depth pre-passes)
+	"out vec3 position;\n"
+	"out vec3 normal;\n"
+	"out vec4 color;\n"
+	"out vec2 texCoord;\n"
+	"void main() {\n"
+	"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+	"	position = OBJECT_TO_LIGHT * Position;\n"
+	"	normal = NORMAL_TO_LIGHT * Normal;\n"
+	"	color = Color;\n"
+	"	texCoord = TexCoord;\n"
+	"}\n";
+
+static std::string const fragment_source =
+	"#version 330\n"
+	"uniform int INSPECT_MODE;\n"
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in vec4 color;\n"
+	"in vec2 texCoord;\n"
+	"out vec4 fragColor;\n"
+	"vec3 grid(vec3 p) {\n"
+	"	vec3 ret;\n"
+	"	ret.x = fract(p.x);\n"
+	"	ret.y = fract(p.y);\n"
+	"	ret.z = fract(p.z);\n"
+	"	return ret;\n"
+	"}\n"
+	"void main() {\n"
+	"	vec3 n = normalize(normal);\n"
+	"	if (INSPECT_MODE == 1) {\n"
+	"		fragColor = vec4(grid(position), 1.0);\n"
+	"	} else if (INSPECT_MODE == 2) {\n"
+	"		fragColor = vec4((0.5 * n) + 0.5, 1.0);\n"
+	"	} else if (INSPECT_MODE == 3) {\n"
+	"		fragColor = color;\n"
+	"	} else if (INSPECT_MODE == 4) {\n"
+	"		fragColor = vec4(grid(vec3(texCoord,0.0)), 1.0);\n"
+	"	} else {\n"
+	"		vec3 l = vec3(0.0,0.0,1.0);\n"
+	"		fragColor = vec4(mix(vec3(0.5), vec3(1.0), 0.5 * dot(n,l) + 0.5) * color.rgb, color.a);\n"
+	"	}\n"
+	"}\n";
 
+//(sources are picked when submitted, since hot-reloading is turned on after globals are constructed)
+static SubmittedProgram submitted_program("ShowSceneProgram",
+	[]() { return shader_source("ShowSceneProgram.vert", vertex_source); },
+	[]() { return shader_source("ShowSceneProgram.frag", fragment_source); }
+);
+
+//point the pipeline template at a program:
+static void set_pipeline_program(ShowSceneProgram const *ret) {
 	show_scene_program_pipeline.program = ret->program;
+	show_scene_program_pipeline.invariant_position = true; //(see vertex shader)
 
 	show_scene_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
 	show_scene_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	show_scene_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+}
+
+Load< ShowSceneProgram > show_scene_program(LoadTagEarly, []() -> ShowSceneProgram * {
+	//wait for the program submitted above to finish compiling (throws on errors):
+	auto *ret = new ShowSceneProgram(submitted_program.finish());
+
+	set_pipeline_program(ret);
+
+	//----- hot-reloading (if enabled) -----
+	watch_shader_program(show_scene_program, "ShowSceneProgram", "ShowSceneProgram.vert", "ShowSceneProgram.frag", set_pipeline_program);
 
 	return ret;
 });
 
-ShowSceneProgram::ShowSceneProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
-		"out vec3 position;\n"
-		"out vec3 normal;\n"
-		"out vec4 color;\n"
-		"out vec2 texCoord;\n"
-		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
-		"	color = Color;\n"
-		"	texCoord = TexCoord;\n"
-		"}\n"
-	,
-		//fragment shader:
-		"#version 330\n"
-		"uniform int INSPECT_MODE;\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
-		"vec3 grid(vec3 p) {\n"
-		"	vec3 ret;\n"
-		"	ret.x = fract(p.x);\n"
-		"	ret.y = fract(p.y);\n"
-		"	ret.z = fract(p.z);\n"
-		"	return ret;\n"
-		"}\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	if (INSPECT_MODE == 1) {\n"
-		"		fragColor = vec4(grid(position), 1.0);\n"
-		"	} else if (INSPECT_MODE == 2) {\n"
-		"		fragColor = vec4((0.5 * n) + 0.5, 1.0);\n"
-		"	} else if (INSPECT_MODE == 3) {\n"
-		"		fragColor = color;\n"
-		"	} else if (INSPECT_MODE == 4) {\n"
-		"		fragColor = vec4(grid(vec3(texCoord,0.0)), 1.0);\n"
-		"	} else {\n"
-		"		vec3 l = vec3(0.0,0.0,1.0);\n"
-		"		fragColor = vec4(mix(vec3(0.5), vec3(1.0), 0.5 * dot(n,l) + 0.5) * color.rgb, color.a);\n"
-		"	}\n"
-		"}\n"
-	);
+ShowSceneProgram::ShowSceneProgram(GLuint program_) : program(program_) {
 
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
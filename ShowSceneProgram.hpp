@@ -8,7 +8,8 @@
 //Shader program that provides various modes for visualizing positions,
 // colors, normals, and texture coordinates; mostly useful for debugging.
 struct ShowSceneProgram {
-	ShowSceneProgram();
+	//takes ownership of a linked program and looks up its attribute and uniform locations:
+	ShowSceneProgram(GLuint program);
 	~ShowSceneProgram();
 
 	GLuint program = 0;
@@ -1,10 +1,16 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "resample.hpp"
 
 #include <SDL.h>
 
 #include <list>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <type_traits>
 #include <cassert>
 #include <exception>
 #include <iostream>
@@ -23,6 +29,21 @@ namespace {
 	//list of all currently playing samples:
 	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
 
+	//all submix buses (a list, so pointers to buses stay valid):
+	std::list< Sound::Bus > buses;
+
+	//mixer stats; only touched by the audio callback:
+	Sound::MixerStats mixer_stats;
+
+	//mixer stats as last published by the audio callback:
+	// (seqlock-style: the sequence number is odd while a publish is in progress,
+	//  and readers retry if it changed while they were copying)
+	constexpr uint32_t const STATS_WORDS = sizeof(Sound::MixerStats) / sizeof(uint32_t);
+	static_assert(sizeof(Sound::MixerStats) % sizeof(uint32_t) == 0, "MixerStats can be copied as words");
+	static_assert(std::is_trivially_copyable< Sound::MixerStats >::value, "MixerStats can be copied with memcpy");
+	std::atomic< uint32_t > published_stats_sequence(0);
+	std::array< std::atomic< uint32_t >, STATS_WORDS > published_stats;
+
 }
 
 //public-facing data:
@@ -33,6 +54,9 @@ Sound::Ramp< float > Sound::volume = Sound::Ramp< float >(1.0f);
 //global listener information:
 Sound::Listener Sound::listener;
 
+//level below which "3D" samples aren't mixed (0.001 ~= -60dB):
+float Sound::audibility_threshold = 0.001f;
+
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
@@ -78,6 +102,11 @@ void Sound::init() {
 		SDL_PauseAudioDevice(device, 0);
 		std::cout << "Audio output initialized." << std::endl;
 	}
+
+	//make sure the standard buses exist:
+	get_bus("music");
+	get_bus("sfx");
+	get_bus("ui");
 }
 
 
@@ -99,24 +128,24 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false);
+std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan, Bus *bus) {
+	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false, bus);
 	lock();
 	playing_samples.emplace_back(playing_sample);
 	unlock();
 	return playing_sample;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false);
+std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Bus *bus) {
+	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false, bus);
 	lock();
 	playing_samples.emplace_back(playing_sample);
 	unlock();
 	return playing_sample;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true);
+std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan, Bus *bus) {
+	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true, bus);
 	lock();
 	playing_samples.emplace_back(playing_sample);
 	unlock();
@@ -125,8 +154,8 @@ std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float
 
 
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true);
+std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Bus *bus) {
+	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true, bus);
 	lock();
 	playing_samples.emplace_back(playing_sample);
 	unlock();
@@ -134,6 +163,18 @@ std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, flo
 }
 
 
+Sound::Bus *Sound::get_bus(std::string const &name) {
+	lock();
+	auto f = std::find_if(buses.begin(), buses.end(), [&](Bus const &bus){ return bus.name == name; });
+	if (f == buses.end()) {
+		buses.emplace_back(name);
+		f = std::prev(buses.end());
+	}
+	Bus *ret = &*f;
+	unlock();
+	return ret;
+}
+
 void Sound::stop_all_samples() {
 	lock();
 	for (auto &s : playing_samples) {
@@ -142,6 +183,29 @@ void Sound::stop_all_samples() {
 	unlock();
 }
 
+void Sound::set_audibility_threshold(float new_threshold) {
+	lock();
+	audibility_threshold = new_threshold;
+	unlock();
+}
+
+Sound::MixerStats Sound::get_mixer_stats() {
+	std::array< uint32_t, STATS_WORDS > words;
+	uint32_t before, after;
+	do {
+		before = published_stats_sequence.load(std::memory_order_acquire);
+		for (uint32_t w = 0; w < STATS_WORDS; ++w) {
+			words[w] = published_stats[w].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = published_stats_sequence.load(std::memory_order_relaxed);
+	} while (before != after || (before & 1));
+
+	MixerStats ret;
+	std::memcpy(reinterpret_cast< char * >(&ret), words.data(), sizeof(ret));
+	return ret;
+}
+
 void Sound::set_volume(float new_volume, float ramp) {
 	lock();
 	volume.set(new_volume, ramp);
@@ -150,6 +214,31 @@ void Sound::set_volume(float new_volume, float ramp) {
 
 //------------------
 
+Sound::Bus::Bus(std::string const &name_) : name(name_), left(MIX_SAMPLES, 0.0f), right(MIX_SAMPLES, 0.0f) {
+}
+
+void Sound::Bus::set_volume(float new_volume, float ramp) {
+	Sound::lock();
+	volume.set(new_volume, ramp);
+	Sound::unlock();
+}
+
+void Sound::Bus::add_effect(std::shared_ptr< Effect > const &effect) {
+	Sound::lock();
+	effects.emplace_back(effect);
+	Sound::unlock();
+}
+
+void Sound::Bus::clear_effects() {
+	//(release effects outside the lock, in case they are expensive to free)
+	std::vector< std::shared_ptr< Effect > > old;
+	Sound::lock();
+	std::swap(old, effects);
+	Sound::unlock();
+}
+
+//------------------
+
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
 	Sound::lock();
 	if (!stopping) {
@@ -179,6 +268,18 @@ void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp)
 	Sound::unlock();
 }
 
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) {
+	Sound::lock();
+	rate.set(std::max(0.0f, new_rate), ramp);
+	Sound::unlock();
+}
+
+void Sound::PlayingSample::set_interpolation(Interpolation new_interpolation) {
+	Sound::lock();
+	interpolation = new_interpolation;
+	Sound::unlock();
+}
+
 void Sound::PlayingSample::stop(float ramp) {
 	Sound::lock();
 	if (!(stopping || stopped)) {
@@ -251,6 +352,23 @@ void compute_pan_from_listener_and_position(
 	}
 }
 
+//helper: can a 3D source possibly be heard above Sound::audibility_threshold?
+// pan weights are never (much) more than one, so the loudest the source can be is gain / (1 + distance / half_radius);
+// comparing squared distances keeps this cheap enough to run before compute_pan_from_listener_and_position:
+bool audible_from_listener(
+	glm::vec3 const &listener_position,
+	glm::vec3 const &source_position,
+	float source_half_radius,
+	float gain
+	) {
+	if (Sound::audibility_threshold <= 0.0f) return true;
+	if (gain < Sound::audibility_threshold) return false;
+	//gain / (1 + distance / half_radius) >= threshold exactly when distance <= max_distance:
+	float max_distance = source_half_radius * (gain / Sound::audibility_threshold - 1.0f);
+	glm::vec3 to = source_position - listener_position;
+	return glm::dot(to, to) <= max_distance * max_distance;
+}
+
 //helper: ramp updates...
 constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
 
@@ -310,10 +428,49 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 }
 
 
+//helper: the Resample::TAPS values of data around playing_sample.i (that is, starting at data[i - Resample::BEFORE]):
+// near the ends of the data, values are copied to 'scratch' (wrapping if looping, zero-padding otherwise):
+float const *sinc_window(Sound::PlayingSample const &playing_sample, float *scratch) {
+	std::vector< float > const &data = playing_sample.data;
+	uint32_t size = uint32_t(data.size());
+	if (playing_sample.i >= Resample::BEFORE && playing_sample.i - Resample::BEFORE + Resample::TAPS <= size) {
+		return &data[playing_sample.i - Resample::BEFORE];
+	}
+	for (uint32_t k = 0; k < Resample::TAPS; ++k) {
+		int64_t j = int64_t(playing_sample.i) + int64_t(k) - int64_t(Resample::BEFORE);
+		if (playing_sample.loop) {
+			j %= int64_t(size);
+			if (j < 0) j += size;
+			scratch[k] = data[size_t(j)];
+		} else {
+			scratch[k] = (j >= 0 && j < int64_t(size) ? data[size_t(j)] : 0.0f);
+		}
+	}
+	return scratch;
+}
+
+//helper: copy mixer_stats to published_stats (only called from the audio callback):
+void publish_mixer_stats() {
+	std::array< uint32_t, STATS_WORDS > words;
+	std::memcpy(words.data(), reinterpret_cast< char const * >(&mixer_stats), sizeof(mixer_stats));
+
+	uint32_t sequence = published_stats_sequence.load(std::memory_order_relaxed);
+	published_stats_sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (uint32_t w = 0; w < STATS_WORDS; ++w) {
+		published_stats[w].store(words[w], std::memory_order_relaxed);
+	}
+	published_stats_sequence.store(sequence + 2, std::memory_order_release);
+}
+
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
 
+	auto mix_start = std::chrono::steady_clock::now();
+	uint32_t active_voices = 0;
+	uint32_t culled_voices = 0;
+
 	struct LR {
 		float l;
 		float r;
@@ -322,10 +479,17 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
-	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
-		buffer[s].l = 0.0f;
-		buffer[s].r = 0.0f;
+	//samples are mixed into separate left and right buffers (one for each bus, plus 'master' for samples not on a bus),
+	// which keeps the per-sample loops in effects and bus mixing simple (and easy to vectorize):
+	static float master_left[MIX_SAMPLES];
+	static float master_right[MIX_SAMPLES];
+
+	//zero the mix buffers:
+	std::fill(master_left, master_left + MIX_SAMPLES, 0.0f);
+	std::fill(master_right, master_right + MIX_SAMPLES, 0.0f);
+	for (auto &bus : buses) {
+		std::fill(bus.left.begin(), bus.left.end(), 0.0f);
+		std::fill(bus.right.begin(), bus.right.end(), 0.0f);
 	}
 
 	//update global values:
@@ -345,15 +509,24 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
 		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
 
+		//where this sample is mixed to:
+		float *out_left = (playing_sample.bus ? playing_sample.bus->left.data() : master_left);
+		float *out_right = (playing_sample.bus ? playing_sample.bus->right.data() : master_right);
+
 		//Figure out sample panning/volume at start...
 		LR start_pan;
 		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
 			//3D panning
-			compute_pan_from_listener_and_position(
-				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&start_pan.l, &start_pan.r);
+			if (playing_sample.virtualized) {
+				//sample was inaudible last mix period, so fade in from silence:
+				start_pan.l = start_pan.r = 0.0f;
+			} else {
+				compute_pan_from_listener_and_position(
+					start_position, start_right,
+					playing_sample.position.value,
+					playing_sample.half_volume_radius.value,
+					&start_pan.l, &start_pan.r);
+			}
 
 			step_position_ramp(playing_sample.position);
 			step_value_ramp(playing_sample.half_volume_radius);
@@ -368,15 +541,30 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 
 		step_value_ramp(playing_sample.volume);
 
+		//playback rate at start and end of the mix period:
+		float start_rate = playing_sample.rate.value;
+		step_value_ramp(playing_sample.rate);
+		float end_rate = playing_sample.rate.value;
+
 		//..and end of the mix period:
 		LR end_pan;
 		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
 			//3D panning
-			compute_pan_from_listener_and_position(
-				end_position, end_right,
+			playing_sample.virtualized = !audible_from_listener(
+				end_position,
 				playing_sample.position.value,
 				playing_sample.half_volume_radius.value,
-				&end_pan.l, &end_pan.r);
+				end_volume * playing_sample.volume.value);
+			if (playing_sample.virtualized) {
+				//sample is too far away to hear, so fade out (or stay silent):
+				end_pan.l = end_pan.r = 0.0f;
+			} else {
+				compute_pan_from_listener_and_position(
+					end_position, end_right,
+					playing_sample.position.value,
+					playing_sample.half_volume_radius.value,
+					&end_pan.l, &end_pan.r);
+			}
 		} else {
 			//2D panning
 			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
@@ -393,24 +581,86 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 
 		assert(playing_sample.i < playing_sample.data.size());
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+		if (start_pan.l == 0.0f && start_pan.r == 0.0f && end_pan.l == 0.0f && end_pan.r == 0.0f) {
+			//silent for the whole mix period (e.g., a virtual voice), so just advance position in sample:
+			culled_voices += 1;
+			float advance = playing_sample.t + 0.5f * (start_rate + end_rate) * float(MIX_SAMPLES);
+			uint32_t steps = uint32_t(advance);
+			playing_sample.t = advance - float(steps);
+			uint32_t remaining = uint32_t(playing_sample.data.size()) - playing_sample.i;
+			if (steps < remaining) {
+				playing_sample.i += steps;
+			} else if (playing_sample.loop) {
+				playing_sample.i = uint32_t((uint64_t(playing_sample.i) + steps) % playing_sample.data.size());
+			} else {
+				playing_sample.i = uint32_t(playing_sample.data.size());
+			}
+		} else if (start_rate == 1.0f && end_rate == 1.0f && playing_sample.t == 0.0f) {
+			active_voices += 1;
+
+			for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
+				//mix one sample based on current pan values:
+				out_left[i] += pan.l * playing_sample.data[playing_sample.i];
+				out_right[i] += pan.r * playing_sample.data[playing_sample.i];
+
+				//update position in sample:
+				playing_sample.i += 1;
+				if (playing_sample.i == playing_sample.data.size()) {
+					if (playing_sample.loop) {
+						playing_sample.i = 0;
+					} else {
+						break;
+					}
+				}
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
+				//update pan values:
+				pan.l += pan_step.l;
+				pan.r += pan_step.r;
+			}
+		} else {
+			//playing at some other rate, so need to interpolate between samples:
+			active_voices += 1;
+
+			std::vector< float > const &data = playing_sample.data;
+			uint32_t size = uint32_t(data.size());
+			float rate = start_rate;
+			float rate_step = (end_rate - start_rate) / MIX_SAMPLES;
+			float scratch[Resample::TAPS];
+
+			for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
+				//interpolate value at position i + t in sample:
+				float value;
+				if (playing_sample.interpolation == Sound::PlayingSample::Linear) {
+					uint32_t next = playing_sample.i + 1;
+					float a = data[playing_sample.i];
+					float b = (next < size ? data[next] : (playing_sample.loop ? data[0] : 0.0f));
+					value = a + playing_sample.t * (b - a);
 				} else {
-					break;
+					value = Resample::sinc(sinc_window(playing_sample, scratch), playing_sample.t);
+				}
+
+				//mix one sample based on current pan values:
+				out_left[i] += pan.l * value;
+				out_right[i] += pan.r * value;
+
+				//update position in sample:
+				playing_sample.t += rate;
+				uint32_t steps = uint32_t(playing_sample.t);
+				playing_sample.t -= float(steps);
+				playing_sample.i += steps;
+				if (playing_sample.i >= size) {
+					if (playing_sample.loop) {
+						playing_sample.i %= size;
+					} else {
+						break;
+					}
 				}
-			}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+				//update pan and rate values:
+				pan.l += pan_step.l;
+				pan.r += pan_step.r;
+				rate += rate_step;
+			}
 		}
 
 		if (playing_sample.i >= playing_sample.data.size()
@@ -425,6 +675,31 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		}
 	}
 
+	//run each bus's effects and mix it into master:
+	for (auto &bus : buses) {
+		for (auto const &effect : bus.effects) {
+			effect->process(bus.left.data(), bus.right.data(), MIX_SAMPLES);
+		}
+
+		float bus_volume = bus.volume.value;
+		step_value_ramp(bus.volume);
+		float bus_volume_step = (bus.volume.value - bus_volume) / MIX_SAMPLES;
+
+		float const *bus_left = bus.left.data();
+		float const *bus_right = bus.right.data();
+		for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+			float v = bus_volume + bus_volume_step * float(s);
+			master_left[s] += v * bus_left[s];
+			master_right[s] += v * bus_right[s];
+		}
+	}
+
+	//copy master to the (interleaved) output buffer:
+	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+		buffer[s].l = master_left[s];
+		buffer[s].r = master_right[s];
+	}
+
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
@@ -433,6 +708,25 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
 	*/
 
+	//count frames that will clip on output:
+	uint32_t clipped_frames = 0;
+	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+		if (std::abs(buffer[s].l) > 1.0f || std::abs(buffer[s].r) > 1.0f) clipped_frames += 1;
+	}
+
+	//update and publish stats:
+	float mix_time = std::chrono::duration< float >(std::chrono::steady_clock::now() - mix_start).count();
+	mixer_stats.callbacks += 1;
+	mixer_stats.deadline = RAMP_STEP; //(== MIX_SAMPLES / AUDIO_RATE)
+	mixer_stats.last_mix_time = mix_time;
+	mixer_stats.max_mix_time = std::max(mixer_stats.max_mix_time, mix_time);
+	if (mix_time > RAMP_STEP) mixer_stats.overruns += 1;
+	mixer_stats.active_voices = active_voices;
+	mixer_stats.culled_voices = culled_voices;
+	mixer_stats.clipped_frames += clipped_frames;
+	if (clipped_frames) mixer_stats.clip_events += 1;
+
+	publish_mixer_stats();
 }
 
 
@@ -48,6 +48,36 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
+//Effects process audio on a Bus, one whole mix period at a time:
+// (process() is called from the audio thread, so change effect parameters between Sound::lock() and Sound::unlock();
+//  see SoundEffects.hpp for some handy effects)
+struct Effect {
+	virtual ~Effect() { }
+	//process 'count' samples of (non-interleaved) stereo audio in place:
+	virtual void process(float *left, float *right, uint32_t count) = 0;
+};
+
+//'Bus' objects are submixes: samples played on a bus are mixed together,
+// run through the bus's effects, and then mixed to the output at the bus's volume.
+// (look up buses with Sound::get_bus; don't create them directly)
+struct Bus {
+	//change the volume of everything on this bus (e.g., to duck music under dialog):
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	//add an effect to the end of this bus's effect chain:
+	void add_effect(std::shared_ptr< Effect > const &effect);
+	//remove all effects from this bus:
+	void clear_effects();
+
+	//internals:
+	//NOTE: Bus is used in a separate thread; so use the functions above to change it.
+	std::string name;
+	Ramp< float > volume = Ramp< float >(1.0f);
+	std::vector< std::shared_ptr< Effect > > effects;
+	std::vector< float > left, right; //submix buffers (one mix period long)
+
+	Bus(std::string const &name);
+};
+
 // 'PlayingSample' objects book-keep samples that are currently playing:
 struct PlayingSample {
 	//change the panning or volume of a playing sample (and do proper locking);
@@ -59,6 +89,15 @@ struct PlayingSample {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	//set the half-volume radius (use only on "3D" playing sounds):
 	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	//set the playback rate (1.0 is normal; 2.0 plays twice as fast and an octave higher; useful for pitch shifts and doppler):
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f);
+
+	//how to compute values between samples when playing at a rate other than 1.0:
+	enum Interpolation : uint8_t {
+		Sinc, //windowed-sinc; good quality
+		Linear //much cheaper; fine for lots of quiet voices
+	};
+	void set_interpolation(Interpolation new_interpolation);
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
 	void stop(float ramp = 1.0f / 60.0f);
@@ -68,12 +107,19 @@ struct PlayingSample {
 	// may result in bad results. Instead, use the functions above, which perform locking!
 	std::vector< float > const &data; //reference to sample data being played
 	uint32_t i = 0; //next data value to read
+	float t = 0.0f; //fractional position between data[i] and data[i+1] (only nonzero when rate isn't 1.0)
 	bool loop = false; //should playback loop after data runs out?
 	bool stopping = false; //is playing stopping?
 	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
+	bool virtualized = false; //is a "3D" sample too far away to hear? (if so, playback advances but nothing is mixed)
+	Bus *bus = nullptr; //submix bus this sample plays on (nullptr == directly to output)
 
 	Ramp< float > volume = Ramp< float >(1.0f);
 
+	//playback rate control:
+	Ramp< float > rate = Ramp< float >(1.0f);
+	Interpolation interpolation = Sinc;
+
 	//2D playback panning control: ('NaN' if sound played in 3D mode)
 	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
 
@@ -81,10 +127,10 @@ struct PlayingSample {
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
 	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
 
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_, Bus *bus_ = nullptr)
+		: data(sample_.data), loop(loop_), bus(bus_), volume(volume_), pan(pan_) { }
+	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_, Bus *bus_ = nullptr)
+		: data(sample_.data), loop(loop_), bus(bus_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
 };
 
 // ------- global functions -------
@@ -93,19 +139,26 @@ void init(); //call Sound::init() from main.cpp before using any member function
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Look up a submix bus by name, creating it if it doesn't exist yet:
+// ("music", "sfx", and "ui" buses always exist)
+Bus *get_bus(std::string const &name);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
+//  all of the play/loop functions take an optional 'bus' to play on (default is directly to output).
 std::shared_ptr< PlayingSample > play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus *bus = nullptr
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
 std::shared_ptr< PlayingSample > play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus *bus = nullptr
 );
 
 //Call 'Sound::loop' to play a sample ~forever~.
@@ -113,14 +166,16 @@ std::shared_ptr< PlayingSample > play_3D(
 std::shared_ptr< PlayingSample > loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus *bus = nullptr
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
 std::shared_ptr< PlayingSample > loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus *bus = nullptr
 );
 
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
@@ -140,6 +195,29 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//"3D" samples whose loudest possible output (after distance attenuation) is below this level become virtual voices:
+// they keep playing silently without being mixed, and fade back in when the listener gets close enough.
+// (set to 0.0 to always mix every sample)
+void set_audibility_threshold(float new_threshold);
+extern float audibility_threshold;
+
+//Mixer performance counters, published by the audio callback after every mix period:
+struct MixerStats {
+	uint64_t callbacks = 0; //number of mix periods so far
+	float deadline = 0.0f; //length of audio produced per mix period (seconds); mixing must take less than this
+	float last_mix_time = 0.0f; //time spent in most recent mix period (seconds)
+	float max_mix_time = 0.0f; //worst time spent in any mix period (seconds)
+	uint64_t overruns = 0; //number of mix periods that took longer than 'deadline'
+	uint32_t active_voices = 0; //samples mixed in most recent mix period
+	uint32_t culled_voices = 0; //samples advanced without mixing (inaudible) in most recent mix period
+	uint64_t clipped_frames = 0; //number of output frames (so far) with a channel outside [-1,1]
+	uint64_t clip_events = 0; //number of mix periods (so far) containing any clipped frames
+};
+
+//get a consistent copy of the most recently published stats:
+// (lock-free -- never waits on the audio callback, so it is fine to call every frame)
+MixerStats get_mixer_stats();
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
 // the set_*/stop/play/... functions already use these helpers, so you shouldn't need
 // to call them unless your code is modifying values directly:
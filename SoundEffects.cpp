@@ -0,0 +1,202 @@
+#include "SoundEffects.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//Effects run inside the audio callback on one mix period at a time,
+// so loops here are written over plain float arrays (left, right, and scratch buffers)
+// which lets the compiler vectorize the non-recursive parts (gain, mixing).
+
+namespace {
+	constexpr float const AUDIO_RATE = 48000.0f; //(must match Sound.cpp)
+	constexpr float const PI = 3.14159265358979f;
+}
+
+//------------------ Biquad ------------------
+
+Sound::Biquad::Biquad(Type type, float frequency, float q, float gain_db) {
+	set(type, frequency, q, gain_db);
+}
+
+void Sound::Biquad::set(Type type, float frequency, float q, float gain_db) {
+	frequency = std::max(1.0f, std::min(frequency, 0.49f * AUDIO_RATE));
+	q = std::max(q, 0.01f);
+
+	float w0 = 2.0f * PI * frequency / AUDIO_RATE;
+	float cos_w0 = std::cos(w0);
+	float alpha = std::sin(w0) / (2.0f * q);
+
+	float nb0, nb1, nb2, na0, na1, na2;
+	if (type == LowPass) {
+		nb0 = 0.5f * (1.0f - cos_w0);
+		nb1 = 1.0f - cos_w0;
+		nb2 = 0.5f * (1.0f - cos_w0);
+		na0 = 1.0f + alpha;
+		na1 = -2.0f * cos_w0;
+		na2 = 1.0f - alpha;
+	} else if (type == HighPass) {
+		nb0 = 0.5f * (1.0f + cos_w0);
+		nb1 = -(1.0f + cos_w0);
+		nb2 = 0.5f * (1.0f + cos_w0);
+		na0 = 1.0f + alpha;
+		na1 = -2.0f * cos_w0;
+		na2 = 1.0f - alpha;
+	} else { //Peak
+		float A = std::pow(10.0f, gain_db / 40.0f);
+		nb0 = 1.0f + alpha * A;
+		nb1 = -2.0f * cos_w0;
+		nb2 = 1.0f - alpha * A;
+		na0 = 1.0f + alpha / A;
+		na1 = -2.0f * cos_w0;
+		na2 = 1.0f - alpha / A;
+	}
+
+	b0 = nb0 / na0;
+	b1 = nb1 / na0;
+	b2 = nb2 / na0;
+	a1 = na1 / na0;
+	a2 = na2 / na0;
+}
+
+void Sound::Biquad::process(float *left, float *right, uint32_t count) {
+	//each output depends on the previous one, so run channels one at a time with state in registers:
+	float *channels[2] = {left, right};
+	for (uint32_t c = 0; c < 2; ++c) {
+		float *data = channels[c];
+		float s1 = z1[c];
+		float s2 = z2[c];
+		for (uint32_t i = 0; i < count; ++i) {
+			float x = data[i];
+			float y = b0 * x + s1;
+			s1 = b1 * x - a1 * y + s2;
+			s2 = b2 * x - a2 * y;
+			data[i] = y;
+		}
+		//flush denormals so quiet tails don't get slow:
+		if (std::abs(s1) < 1e-20f) s1 = 0.0f;
+		if (std::abs(s2) < 1e-20f) s2 = 0.0f;
+		z1[c] = s1;
+		z2[c] = s2;
+	}
+}
+
+//------------------ Compressor ------------------
+
+Sound::Compressor::Compressor(float threshold_db_, float ratio_, float attack, float release)
+	: threshold_db(threshold_db_), ratio(ratio_) {
+	set_attack_release(attack, release);
+}
+
+void Sound::Compressor::set_attack_release(float attack, float release) {
+	//one-pole smoothing coefficients; envelope moves ~63% of the way to its target in the given time:
+	attack_coef = (attack > 0.0f ? std::exp(-1.0f / (attack * AUDIO_RATE)) : 0.0f);
+	release_coef = (release > 0.0f ? std::exp(-1.0f / (release * AUDIO_RATE)) : 0.0f);
+}
+
+void Sound::Compressor::process(float *left, float *right, uint32_t count) {
+	if (gain.size() < count) gain.resize(count);
+
+	float threshold = std::pow(10.0f, threshold_db / 20.0f);
+	float makeup = std::pow(10.0f, makeup_db / 20.0f);
+	//above threshold, level L comes out as threshold * (L / threshold)^(1/ratio):
+	float exponent = 1.0f - 1.0f / std::max(ratio, 1.0f);
+
+	//first pass: follow the envelope and compute gain (recursive, so scalar):
+	float env = envelope;
+	for (uint32_t i = 0; i < count; ++i) {
+		float level = std::max(std::abs(left[i]), std::abs(right[i]));
+		float coef = (level > env ? attack_coef : release_coef);
+		env = level + coef * (env - level);
+		if (env > threshold) {
+			gain[i] = makeup * (exponent == 1.0f ? threshold / env : std::pow(threshold / env, exponent));
+		} else {
+			gain[i] = makeup;
+		}
+	}
+	envelope = (env < 1e-20f ? 0.0f : env);
+
+	//second pass: apply gain (vectorizes):
+	float const *g = gain.data();
+	for (uint32_t i = 0; i < count; ++i) {
+		left[i] *= g[i];
+		right[i] *= g[i];
+	}
+}
+
+//------------------ Reverb ------------------
+
+Sound::Reverb::Reverb(float room_size_, float damping_, float wet_, float dry_)
+	: room_size(room_size_), damping(damping_), wet(wet_), dry(dry_) {
+	//Freeverb delay lengths (tuned for 44.1kHz; scaled to our rate), with the right channel slightly longer for stereo spread:
+	constexpr uint32_t const COMB_TUNING[8] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617};
+	constexpr uint32_t const ALLPASS_TUNING[4] = {556, 441, 341, 225};
+	constexpr uint32_t const STEREO_SPREAD = 23;
+	constexpr float const SCALE = AUDIO_RATE / 44100.0f;
+
+	for (uint32_t c = 0; c < 2; ++c) {
+		for (uint32_t k = 0; k < combs[c].size(); ++k) {
+			combs[c][k].buffer.assign(uint32_t((COMB_TUNING[k] + c * STEREO_SPREAD) * SCALE), 0.0f);
+		}
+		for (uint32_t k = 0; k < allpasses[c].size(); ++k) {
+			allpasses[c][k].buffer.assign(uint32_t((ALLPASS_TUNING[k] + c * STEREO_SPREAD) * SCALE), 0.0f);
+		}
+	}
+}
+
+void Sound::Reverb::process(float *left, float *right, uint32_t count) {
+	if (input.size() < count) input.resize(count);
+	if (output.size() < count) output.resize(count);
+
+	float feedback = 0.7f + 0.28f * std::max(0.0f, std::min(room_size, 1.0f));
+	float damp = 0.4f * std::max(0.0f, std::min(damping, 1.0f));
+
+	//reverb network runs on a mono mix of the input:
+	for (uint32_t i = 0; i < count; ++i) {
+		input[i] = 0.015f * (left[i] + right[i]);
+	}
+
+	float *channels[2] = {left, right};
+	for (uint32_t c = 0; c < 2; ++c) {
+		std::fill(output.begin(), output.begin() + count, 0.0f);
+
+		//parallel lowpass-feedback combs:
+		for (Comb &comb : combs[c]) {
+			float *buffer = comb.buffer.data();
+			uint32_t size = uint32_t(comb.buffer.size());
+			uint32_t at = comb.at;
+			float store = comb.store;
+			for (uint32_t i = 0; i < count; ++i) {
+				float delayed = buffer[at];
+				store = delayed + damp * (store - delayed);
+				buffer[at] = input[i] + feedback * store;
+				output[i] += delayed;
+				at += 1;
+				if (at == size) at = 0;
+			}
+			comb.at = at;
+			comb.store = (std::abs(store) < 1e-20f ? 0.0f : store);
+		}
+
+		//series allpasses:
+		for (Allpass &allpass : allpasses[c]) {
+			float *buffer = allpass.buffer.data();
+			uint32_t size = uint32_t(allpass.buffer.size());
+			uint32_t at = allpass.at;
+			for (uint32_t i = 0; i < count; ++i) {
+				float delayed = buffer[at];
+				buffer[at] = output[i] + 0.5f * delayed;
+				output[i] = delayed - output[i];
+				at += 1;
+				if (at == size) at = 0;
+			}
+			allpass.at = at;
+		}
+
+		//mix wet and dry (vectorizes):
+		float *data = channels[c];
+		float const *out = output.data();
+		for (uint32_t i = 0; i < count; ++i) {
+			data[i] = dry * data[i] + wet * out[i];
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Sound.hpp"
+
+#include <vector>
+#include <array>
+
+//Some handy effects to put on a Sound::Bus.
+//Parameters can be changed any time between Sound::lock() and Sound::unlock().
+
+namespace Sound {
+
+//Biquad filter (coefficients from the RBJ "Audio EQ Cookbook"):
+struct Biquad : Effect {
+	enum Type {
+		LowPass,
+		HighPass,
+		Peak, //boost/cut around 'frequency' by 'gain_db'
+	};
+	Biquad(Type type, float frequency, float q = 0.7071f, float gain_db = 0.0f);
+
+	//recompute coefficients (filter state is kept, so this is fine to call while playing):
+	void set(Type type, float frequency, float q = 0.7071f, float gain_db = 0.0f);
+
+	virtual void process(float *left, float *right, uint32_t count) override;
+
+	//coefficients (normalized so a0 == 1):
+	float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+	//filter state (transposed direct form II), per channel:
+	std::array< float, 2 > z1 = {0.0f, 0.0f}, z2 = {0.0f, 0.0f};
+};
+
+//Feed-forward compressor; with ratio == infinity (the default) it works as a limiter:
+struct Compressor : Effect {
+	Compressor(
+		float threshold_db = -1.0f,
+		float ratio = std::numeric_limits< float >::infinity(),
+		float attack = 0.001f, //seconds
+		float release = 0.1f //seconds
+	);
+
+	void set_attack_release(float attack, float release);
+
+	virtual void process(float *left, float *right, uint32_t count) override;
+
+	float threshold_db;
+	float ratio;
+	float makeup_db = 0.0f;
+
+	//envelope follower (on peak level of both channels):
+	float attack_coef = 0.0f, release_coef = 0.0f;
+	float envelope = 0.0f;
+
+	std::vector< float > gain; //per-sample gain scratch buffer
+};
+
+//Simple stereo reverb (the "Freeverb" network: parallel combs into series allpasses):
+struct Reverb : Effect {
+	Reverb(float room_size = 0.5f, float damping = 0.5f, float wet = 0.25f, float dry = 1.0f);
+
+	virtual void process(float *left, float *right, uint32_t count) override;
+
+	float room_size; //0 to 1; longer tail with larger rooms
+	float damping; //0 to 1; high frequencies decay faster with more damping
+	float wet, dry; //output levels
+
+	struct Comb {
+		std::vector< float > buffer;
+		uint32_t at = 0;
+		float store = 0.0f;
+	};
+	struct Allpass {
+		std::vector< float > buffer;
+		uint32_t at = 0;
+	};
+	std::array< std::array< Comb, 8 >, 2 > combs; //[channel][comb]
+	std::array< std::array< Allpass, 4 >, 2 > allpasses; //[channel][allpass]
+
+	std::vector< float > input, output; //mono input / per-channel wet scratch buffers
+};
+
+} //namespace Sound
@@ -0,0 +1,136 @@
+#include "TextLayout.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+TextLayout::TextLayout() {
+	glGenBuffers(1, &vbo);
+	glGenVertexArrays(1, &vao);
+
+	//vertices are (x, y, s, t) in attribute 0:
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	GL_ERRORS();
+}
+
+TextLayout::~TextLayout() {
+	glDeleteVertexArrays(1, &vao);
+	vao = 0;
+	glDeleteBuffers(1, &vbo);
+	vbo = 0;
+}
+
+void TextLayout::build(
+	std::vector< std::string > const &lines,
+	std::vector< std::shared_ptr< ShapeCache::Run const > > const &runs,
+	FT_Face face,
+	GlyphAtlas &atlas,
+	float glyph_scale) {
+	assert(lines.size() == runs.size());
+
+	struct Vertex {
+		float x, y, s, t;
+	};
+	static_assert(sizeof(Vertex) == 4 * sizeof(float), "Vertex is packed");
+	std::vector< Vertex > vertices;
+
+	//if the atlas evicts a shelf partway through, glyphs looked up earlier may have been overwritten,
+	// so lay everything out again (now mostly from glyphs already in the atlas);
+	// if that evicts too, the text needs more glyphs than the atlas holds at once, so grow the atlas:
+	for (uint32_t attempt = 0; ; ++attempt) {
+		vertices.clear();
+		quad_bytes.clear();
+
+		uint32_t before_evictions = atlas.evictions;
+
+		//pen position, in pixels (+y is up):
+		float line_y = 0.0f;
+		size_t line_start = 0;
+		for (size_t l = 0; l < lines.size(); ++l) {
+			float pen_x = 0.0f;
+			float pen_y = line_y;
+			for (ShapeCache::Glyph const &g : runs[l]->glyphs) {
+				GlyphAtlas::Glyph const *glyph = atlas.lookup(g.index);
+
+				if (glyph && glyph->size.x > 0 && glyph->size.y > 0) {
+					//(same placement PlayMode has always used; atlas sizes are scaled by glyph_scale and SDF glyphs have padding around the outline)
+					float x = pen_x + (g.x_offset + 400 * 64.0f) / 64.0f - glyph->padding * glyph_scale;
+					float y = pen_y + (g.y_offset / 64.0f) - ((face->bbox.yMax - face->bbox.yMin) / 64.0f - (glyph->bearing_y + glyph->padding) * glyph_scale);
+					float w = glyph->size.x * glyph_scale;
+					float h = glyph->size.y * glyph_scale;
+
+					glm::vec2 const &uv0 = glyph->uv_min;
+					glm::vec2 const &uv1 = glyph->uv_max;
+
+					vertices.emplace_back(Vertex{x    , y    , uv0.x, uv0.y});
+					vertices.emplace_back(Vertex{x    , y - h, uv0.x, uv1.y});
+					vertices.emplace_back(Vertex{x + w, y    , uv1.x, uv0.y});
+					vertices.emplace_back(Vertex{x + w, y    , uv1.x, uv0.y});
+					vertices.emplace_back(Vertex{x    , y - h, uv0.x, uv1.y});
+					vertices.emplace_back(Vertex{x + w, y - h, uv1.x, uv1.y});
+					quad_bytes.emplace_back(line_start + g.cluster);
+				}
+
+				pen_x += g.x_advance / 64.0f;
+				pen_y += g.y_advance / 64.0f;
+			}
+			line_start += lines[l].size();
+			line_y -= face->size->metrics.height / 64.0f;
+		}
+
+		if (atlas.evictions == before_evictions) break;
+		if (attempt == 0) continue;
+
+		GLint max_size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+		if (atlas.size * 2 > uint32_t(max_size)) {
+			std::cerr << "WARNING: glyph atlas (" << atlas.size << "x" << atlas.size << ") can't hold all the glyphs in this text; some glyphs may be wrong." << std::endl;
+			break;
+		}
+		atlas.reset(atlas.size * 2);
+	}
+
+	//reveal order is by byte offset (shaping can reorder clusters within a line, so make sure):
+	if (!std::is_sorted(quad_bytes.begin(), quad_bytes.end())) {
+		std::vector< size_t > order(quad_bytes.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b){ return quad_bytes[a] < quad_bytes[b]; });
+		std::vector< Vertex > sorted_vertices;
+		std::vector< size_t > sorted_bytes;
+		sorted_vertices.reserve(vertices.size());
+		sorted_bytes.reserve(quad_bytes.size());
+		for (size_t q : order) {
+			sorted_vertices.insert(sorted_vertices.end(), vertices.begin() + 6 * q, vertices.begin() + 6 * (q + 1));
+			sorted_bytes.emplace_back(quad_bytes[q]);
+		}
+		vertices = std::move(sorted_vertices);
+		quad_bytes = std::move(sorted_bytes);
+	}
+
+	built_evictions = atlas.evictions;
+
+	//upload (text doesn't change until the next build):
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GL_ERRORS();
+}
+
+void TextLayout::draw(size_t bytes) const {
+	//quads whose text starts before 'bytes' are revealed:
+	size_t quads = std::lower_bound(quad_bytes.begin(), quad_bytes.end(), bytes) - quad_bytes.begin();
+	if (quads == 0) return;
+
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, GLsizei(6 * quads));
+	glBindVertexArray(0);
+}
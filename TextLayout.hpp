@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * TextLayout holds a block of already-shaped, already-positioned text as glyph quads
+ * in a vertex buffer, so drawing it each frame is one draw call.
+ *
+ * Quads are stored in pixels relative to the upper left of the block;
+ * the vertex shader maps them to clip space (see PlayMode's VERTEX_SHADER).
+ *
+ */
+
+#include "GL.hpp"
+#include "GlyphAtlas.hpp"
+#include "ShapeCache.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct TextLayout {
+	TextLayout();
+	~TextLayout();
+
+	TextLayout(TextLayout const &) = delete;
+	TextLayout &operator=(TextLayout const &) = delete;
+
+	//lay out shaped lines (one per entry in 'runs'; 'lines' are the source strings) using glyphs from 'atlas':
+	// face supplies line spacing; glyph_scale converts atlas pixels to face pixels (see GlyphAtlas::SDF)
+	void build(
+		std::vector< std::string > const &lines,
+		std::vector< std::shared_ptr< ShapeCache::Run const > > const &runs,
+		FT_Face face,
+		GlyphAtlas &atlas,
+		float glyph_scale
+	);
+
+	//does the layout need to be built again? (i.e., has the atlas moved glyphs around since build()):
+	bool stale(GlyphAtlas const &atlas) const { return atlas.evictions != built_evictions; }
+
+	//draw the glyphs for the first 'bytes' bytes of the text:
+	// (expects a program that reads (x, y, s, t) from attribute 0 and the atlas texture to be bound)
+	void draw(size_t bytes) const;
+
+	//---- internals ----
+	GLuint vbo = 0, vao = 0;
+
+	//for each quad (in order), the byte offset of its first character in the text (all lines together):
+	std::vector< size_t > quad_bytes;
+
+	uint32_t built_evictions = 0; //atlas.evictions when build() finished
+};
@@ -0,0 +1,128 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+//This program measures how long LightClusters::update takes to assign many moving point and spot lights
+// to clusters, and checks the result against a plain (one light at a time) sphere-vs-cluster test.
+//
+//usage: cluster-bench [frames] [threads]
+
+int main(int argc, char **argv) {
+	uint32_t frames = 300;
+	uint32_t threads = 0;
+	if (argc > 1) frames = uint32_t(std::max(1, std::atoi(argv[1])));
+	if (argc > 2) threads = uint32_t(std::max(0, std::atoi(argv[2])));
+
+	for (uint32_t light_count : {64u, 128u, 256u}) {
+		//scene: camera at the origin looking down -z at a field of lights:
+		Scene scene;
+		scene.transforms.emplace_back();
+		scene.cameras.emplace_back(&scene.transforms.back());
+		Scene::Camera &camera = scene.cameras.back();
+		camera.fovy = glm::radians(60.0f);
+		camera.aspect = 16.0f / 9.0f;
+		camera.near = 0.1f;
+
+		std::mt19937 mt(0x15466 + light_count);
+		auto uniform = [&](float lo, float hi) {
+			return lo + (hi - lo) * std::uniform_real_distribution< float >()(mt);
+		};
+		std::vector< glm::vec3 > velocities;
+		for (uint32_t l = 0; l < light_count; ++l) {
+			scene.transforms.emplace_back();
+			Scene::Transform &transform = scene.transforms.back();
+			transform.position = glm::vec3(uniform(-40.0f, 40.0f), uniform(-4.0f, 4.0f), uniform(-80.0f, 0.0f));
+			transform.rotation = glm::angleAxis(uniform(0.0f, 6.28f), glm::normalize(glm::vec3(uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f), 0.1f)));
+			scene.lights.emplace_back(&transform);
+			Scene::Light &light = scene.lights.back();
+			light.type = (l % 3 == 0 ? Scene::Light::Spot : Scene::Light::Point);
+			light.distance = uniform(2.0f, 8.0f);
+			light.spot_fov = glm::radians(uniform(20.0f, 90.0f));
+			velocities.emplace_back(uniform(-2.0f, 2.0f), 0.0f, uniform(-2.0f, 2.0f));
+		}
+
+		LightClusters clusters(glm::uvec3(16, 9, 24), 100.0f, threads);
+
+		std::vector< double > times;
+		times.reserve(frames);
+		double total_indices = 0.0;
+		uint32_t max_cluster_lights = 0;
+		for (uint32_t f = 0; f < frames; ++f) {
+			//move lights around a bit:
+			uint32_t l = 0;
+			for (auto &light : scene.lights) {
+				light.transform->position += velocities[l++] * (1.0f / 60.0f);
+			}
+
+			clusters.update(camera, scene.lights);
+			times.emplace_back(clusters.stats.update_seconds);
+			total_indices += clusters.stats.indices;
+			max_cluster_lights = std::max(max_cluster_lights, clusters.stats.max_cluster_lights);
+		}
+
+		//check last frame against a simple sphere-vs-box test:
+		// (point lights should match exactly; spot lights may be left out of some clusters by the cone test)
+		uint32_t mismatches = 0;
+		{
+			float const tan_y = std::tan(0.5f * camera.fovy);
+			float const tan_x = tan_y * camera.aspect;
+			float const log_ratio = std::log(clusters.far_depth / camera.near) / float(clusters.grid.z - 1);
+			std::vector< glm::vec3 > positions;
+			std::vector< float > radii;
+			std::vector< bool > spots;
+			float max_depth = clusters.far_depth;
+			for (auto const &light : scene.lights) {
+				positions.emplace_back(light.transform->position);
+				radii.emplace_back(light.distance);
+				spots.emplace_back(light.type == Scene::Light::Spot);
+				max_depth = std::max(max_depth, -light.transform->position.z + light.distance);
+			}
+			for (uint32_t k = 0; k < clusters.grid.z; ++k) {
+				float d0 = camera.near * std::exp(log_ratio * float(k));
+				float d1 = (k + 1 == clusters.grid.z ? std::max(max_depth, 2.0f * clusters.far_depth) : camera.near * std::exp(log_ratio * float(k + 1)));
+				for (uint32_t j = 0; j < clusters.grid.y; ++j) {
+					for (uint32_t i = 0; i < clusters.grid.x; ++i) {
+						float x0 = (-1.0f + 2.0f * float(i) / float(clusters.grid.x)) * tan_x;
+						float x1 = (-1.0f + 2.0f * float(i + 1) / float(clusters.grid.x)) * tan_x;
+						float y0 = (-1.0f + 2.0f * float(j) / float(clusters.grid.y)) * tan_y;
+						float y1 = (-1.0f + 2.0f * float(j + 1) / float(clusters.grid.y)) * tan_y;
+						glm::vec3 box_min(std::min(x0 * d0, x0 * d1), std::min(y0 * d0, y0 * d1), -d1);
+						glm::vec3 box_max(std::max(x1 * d0, x1 * d1), std::max(y1 * d0, y1 * d1), -d0);
+
+						glm::uvec2 range = clusters.ranges[(k * clusters.grid.y + j) * clusters.grid.x + i];
+						std::vector< bool > listed(positions.size(), false);
+						for (uint32_t n = 0; n < range.y; ++n) listed[clusters.indices[range.x + n]] = true;
+
+						for (uint32_t l = 0; l < positions.size(); ++l) {
+							glm::vec3 closest = glm::max(box_min, glm::min(box_max, positions[l]));
+							glm::vec3 offset = positions[l] - closest;
+							bool in_sphere = glm::dot(offset, offset) <= radii[l] * radii[l];
+							if (listed[l] && !in_sphere) ++mismatches;
+							if (!listed[l] && in_sphere && !spots[l]) ++mismatches;
+						}
+					}
+				}
+			}
+		}
+
+		std::sort(times.begin(), times.end());
+		double mean = 0.0;
+		for (double t : times) mean += t;
+		mean /= double(times.size());
+		std::cout << light_count << " lights: "
+			<< (mean * 1000.0) << " ms mean, "
+			<< (times[times.size() / 2] * 1000.0) << " ms median, "
+			<< (times[std::min(times.size() - 1, times.size() * 99 / 100)] * 1000.0) << " ms 99th percentile; "
+			<< (total_indices / frames / (clusters.grid.x * clusters.grid.y * clusters.grid.z)) << " lights/cluster average, "
+			<< max_cluster_lights << " max"
+			<< (mismatches ? "; " + std::to_string(mismatches) + " lights in the wrong clusters!" : "")
+			<< std::endl;
+	}
+
+	return 0;
+}
@@ -1,62 +1,391 @@
 #include "gl_compile_program.hpp"
 
+#include "data_path.hpp"
+#include "gl_errors.hpp"
+#include "read_write_chunk.hpp"
+
+#include <SDL.h>
+
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+//------------------------------------------------
+//Program binary cache:
+// linked programs are saved (via glGetProgramBinary) to data_path("shader-cache/") and loaded
+// (via glProgramBinary) on later runs instead of compiling from source.
+// Entries are keyed by the shader sources and the GL vendor/renderer/version strings, and there is one
+// entry file per program name, so when a program's sources change (or the driver is updated) its new
+// binary replaces the old one instead of piling up next to it.
+// Anything that doesn't load cleanly is deleted and the program is compiled from source.
+
+//program binaries are core in OpenGL 4.1 (and ARB_get_program_binary), so aren't in GL.hpp:
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH          0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS     0x87FE
+typedef void (APIENTRY *PFN_glGetProgramBinary) (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRY *PFN_glProgramBinary) (GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRY *PFN_glProgramParameteri) (GLuint program, GLenum pname, GLint value);
+
+//from KHR_parallel_shader_compile (or ARB_parallel_shader_compile, which has the same values):
+#define GL_COMPLETION_STATUS_KHR          0x91B1
+typedef void (APIENTRY *PFN_glMaxShaderCompilerThreadsKHR) (GLuint count);
+
+namespace {
+	struct ProgramCache {
+		bool supported = false;
+		PFN_glGetProgramBinary GetProgramBinary = nullptr;
+		PFN_glProgramBinary ProgramBinary = nullptr;
+		PFN_glProgramParameteri ProgramParameteri = nullptr;
+		std::string driver; //vendor, renderer, and version strings
+		std::string dir;
+
+		ProgramCache() {
+			GLint major = 0, minor = 0;
+			glGetIntegerv(GL_MAJOR_VERSION, &major);
+			glGetIntegerv(GL_MINOR_VERSION, &minor);
+			bool have = (major > 4 || (major == 4 && minor >= 1));
+			if (!have) {
+				GLint count = 0;
+				glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+				for (GLint i = 0; i < count; ++i) {
+					char const *name = reinterpret_cast< char const * >(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+					if (name && std::strcmp(name, "GL_ARB_get_program_binary") == 0) have = true;
+				}
+			}
+			GLint formats = 0;
+			if (have) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+			GetProgramBinary = reinterpret_cast< PFN_glGetProgramBinary >(SDL_GL_GetProcAddress("glGetProgramBinary"));
+			ProgramBinary = reinterpret_cast< PFN_glProgramBinary >(SDL_GL_GetProcAddress("glProgramBinary"));
+			ProgramParameteri = reinterpret_cast< PFN_glProgramParameteri >(SDL_GL_GetProcAddress("glProgramParameteri"));
+			supported = have && formats > 0 && GetProgramBinary && ProgramBinary && ProgramParameteri;
+
+			auto str = [](GLenum name) -> std::string {
+				char const *val = reinterpret_cast< char const * >(glGetString(name));
+				return (val ? val : "");
+			};
+			driver = str(GL_VENDOR) + '\n' + str(GL_RENDERER) + '\n' + str(GL_VERSION);
+
+			dir = data_path("shader-cache");
+			#if defined(_WIN32)
+			_mkdir(dir.c_str());
+			#else
+			mkdir(dir.c_str(), 0755);
+			#endif
+			//(if making the directory failed, saving entries will fail and the cache just won't be used)
+		}
+	};
+
+	//Background compilation:
+	// with KHR_parallel_shader_compile, the driver compiles on its own threads and
+	// GL_COMPLETION_STATUS_KHR can be polled without blocking.
+	// (without it, submitting everything first still lets drivers that defer work overlap it)
+	struct ParallelCompile {
+		bool supported = false;
+
+		ParallelCompile() {
+			GLint count = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			char const *max_threads_fn = nullptr;
+			for (GLint i = 0; i < count; ++i) {
+				char const *name = reinterpret_cast< char const * >(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+				if (!name) continue;
+				if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0) max_threads_fn = "glMaxShaderCompilerThreadsKHR";
+				else if (std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0 && !max_threads_fn) max_threads_fn = "glMaxShaderCompilerThreadsARB";
+			}
+			if (!max_threads_fn) return;
+			auto MaxShaderCompilerThreads = reinterpret_cast< PFN_glMaxShaderCompilerThreadsKHR >(SDL_GL_GetProcAddress(max_threads_fn));
+			if (!MaxShaderCompilerThreads) return;
+			MaxShaderCompilerThreads(0xffffffffu); //(let the driver pick how many threads)
+			supported = true;
+		}
+	};
+
+	ParallelCompile &get_parallel() {
+		static ParallelCompile parallel;
+		return parallel;
+	}
+
+	//a submitted program that hasn't been checked yet:
+	struct Pending {
+		std::string name;
+		GLuint vertex_shader = 0; //(zero if loaded from cache)
+		GLuint fragment_shader = 0;
+		std::string key; //cache key and file (empty if cache not supported)
+		std::string cache_file;
+		std::chrono::high_resolution_clock::time_point submitted;
+		std::chrono::high_resolution_clock::time_point ready; //when polling first found the program done (if polled)
+		bool ready_known = false;
+	};
+
+	std::unordered_map< GLuint, Pending > &get_pending() {
+		static std::unordered_map< GLuint, Pending > pending;
+		return pending;
+	}
+
+	ProgramCache &get_cache() {
+		static ProgramCache cache; //(created on first use, which is after the GL context exists)
+		return cache;
+	}
 
-static GLuint gl_compile_shader(GLenum type, std::string const &source) {
+	//64-bit FNV-1a:
+	uint64_t hash(std::string const &data) {
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (char c : data) {
+			h = (h ^ uint8_t(c)) * 0x100000001b3ull;
+		}
+		return h;
+	}
+}
+
+//print a shader or program info log:
+static void print_info_log(GLuint object, bool is_program) {
+	GLint info_log_length = 0;
+	if (is_program) glGetProgramiv(object, GL_INFO_LOG_LENGTH, &info_log_length);
+	else glGetShaderiv(object, GL_INFO_LOG_LENGTH, &info_log_length);
+	std::vector< GLchar > info_log(size_t(std::max(info_log_length, 1)), 0);
+	GLsizei length = 0;
+	if (is_program) glGetProgramInfoLog(object, GLint(info_log.size()), &length, &info_log[0]);
+	else glGetShaderInfoLog(object, GLint(info_log.size()), &length, &info_log[0]);
+	std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
+}
+
+static GLuint gl_submit_shader(GLenum type, std::string const &source) {
 	GLuint shader = glCreateShader(type);
 	GLchar const *str = source.c_str();
 	GLint str_length = GLint(source.size());
 	glShaderSource(shader, 1, &str, &str_length);
 	glCompileShader(shader);
-	GLint compile_status = GL_FALSE;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-	if (compile_status != GL_TRUE) {
-		std::cerr << "Failed to compile shader." << std::endl;
-		GLint info_log_length = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
-		std::vector< GLchar > info_log(info_log_length, 0);
-		GLsizei length = 0;
-		glGetShaderInfoLog(shader, GLint(info_log.size()), &length, &info_log[0]);
-		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		glDeleteShader(shader);
-		throw std::runtime_error("Failed to compile shader.");
-	}
+	//(status is checked in gl_finish_program)
 	return shader;
 }
 
-GLuint gl_compile_program(
+//try to load a program from the cache; returns 0 on failure:
+static GLuint load_cached_program(std::string const &key, std::string const &cache_file) {
+	ProgramCache &cache = get_cache();
+	std::ifstream file(cache_file, std::ios::binary);
+	if (!file) return 0;
+
+	GLuint program = 0;
+	try {
+		std::vector< char > stored_key;
+		std::vector< GLenum > format;
+		std::vector< uint8_t > binary;
+		read_chunk(file, "key0", &stored_key);
+		read_chunk(file, "fmt0", &format);
+		read_chunk(file, "bin0", &binary);
+		if (std::string(stored_key.begin(), stored_key.end()) == key && format.size() == 1 && !binary.empty()) {
+			program = glCreateProgram();
+			GL_ERRORS(); //(report anything already pending, so it isn't mistaken for a glProgramBinary error below)
+			cache.ProgramBinary(program, format[0], binary.data(), GLsizei(binary.size()));
+			GLint link_status = GL_FALSE;
+			glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+			if (link_status == GL_TRUE) return program;
+			glGetError(); //(glProgramBinary may flag an error for a binary the driver no longer accepts; that's expected)
+		}
+	} catch (std::exception &) {
+		//(truncated or otherwise corrupt entry)
+	}
+	if (program) glDeleteProgram(program);
+	file.close();
+	std::remove(cache_file.c_str()); //(the program will be compiled and saved again)
+	std::cerr << "Note: replacing stale or corrupt shader cache entry '" << cache_file << "'." << std::endl;
+	return 0;
+}
+
+static void save_cached_program(GLuint program, std::string const &key, std::string const &cache_file) {
+	ProgramCache &cache = get_cache();
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	std::vector< uint8_t > binary(static_cast< size_t >(length));
+	std::vector< GLenum > format(1, 0);
+	GLsizei got = 0;
+	cache.GetProgramBinary(program, length, &got, &format[0], binary.data());
+	binary.resize(size_t(got));
+
+	//write to a temporary file and rename so a partially-written entry is never loaded:
+	std::string temp_file = cache_file + ".tmp";
+	{
+		std::ofstream file(temp_file, std::ios::binary);
+		write_chunk("key0", std::vector< char >(key.begin(), key.end()), &file);
+		write_chunk("fmt0", format, &file);
+		write_chunk("bin0", binary, &file);
+	}
+	std::remove(cache_file.c_str()); //(rename won't replace an existing file on windows)
+	if (std::rename(temp_file.c_str(), cache_file.c_str()) != 0) {
+		std::remove(temp_file.c_str());
+	}
+}
+
+GLuint gl_submit_program(
+	std::string const &name,
 	std::string const &vertex_shader_source,
 	std::string const &fragment_shader_source
 	) {
 
-	GLuint vertex_shader = gl_compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
-	GLuint fragment_shader = gl_compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
+	ProgramCache &cache = get_cache();
+	get_parallel(); //(make sure driver compiler threads are enabled before compiling anything)
+
+	Pending pending;
+	pending.name = name;
+	pending.submitted = std::chrono::high_resolution_clock::now();
+
+	if (cache.supported) {
+		//the full key is stored in the entry (and checked on load) so hash collisions can't load the wrong program:
+		pending.key = cache.driver + '\0' + vertex_shader_source + '\0' + fragment_shader_source;
+		char file[32];
+		std::snprintf(file, sizeof(file), "/%016llx.bin", (unsigned long long)hash(name.empty() ? pending.key : name));
+		pending.cache_file = cache.dir + file;
+
+		GLuint program = load_cached_program(pending.key, pending.cache_file);
+		if (program) {
+			get_pending().emplace(program, pending);
+			return program;
+		}
+	}
+
+	pending.vertex_shader = gl_submit_shader(GL_VERTEX_SHADER, vertex_shader_source);
+	pending.fragment_shader = gl_submit_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
 
 	GLuint program = glCreateProgram();
-	glAttachShader(program, vertex_shader);
-	glAttachShader(program, fragment_shader);
+	glAttachShader(program, pending.vertex_shader);
+	glAttachShader(program, pending.fragment_shader);
 
-	//shaders are reference counted so this makes sure they are freed after program is deleted:
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	//ask to be able to get the binary for the cache:
+	if (cache.supported) cache.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
-	//link the shader program and throw errors if linking fails:
+	//start linking (status is checked in gl_finish_program):
 	glLinkProgram(program);
+
+	get_pending().emplace(program, pending);
+	return program;
+}
+
+GLuint gl_finish_program(GLuint program) {
+	auto &pending_programs = get_pending();
+	auto f = pending_programs.find(program);
+	if (f == pending_programs.end()) return program; //(already finished)
+
+	auto now = []() { return std::chrono::high_resolution_clock::now(); };
+
+	if (get_parallel().supported) {
+		//poll every pending program (not just this one) so each one's ready time is noted as it finishes:
+		while (!f->second.ready_known) {
+			for (auto &[other, pending] : pending_programs) {
+				if (pending.ready_known) continue;
+				GLint done = GL_FALSE;
+				glGetProgramiv(other, GL_COMPLETION_STATUS_KHR, &done);
+				if (done) {
+					pending.ready = now();
+					pending.ready_known = true;
+				}
+			}
+			if (!f->second.ready_known) std::this_thread::yield();
+		}
+	}
+
+	Pending pending = f->second;
+	pending_programs.erase(f);
+
+	//check shaders (if not loaded from cache):
+	bool failed = false;
+	for (GLuint shader : {pending.vertex_shader, pending.fragment_shader}) {
+		if (shader == 0) continue;
+		GLint compile_status = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
+		if (compile_status != GL_TRUE) {
+			std::cerr << "Failed to compile " << (shader == pending.vertex_shader ? "vertex" : "fragment") << " shader for '" << pending.name << "'." << std::endl;
+			print_info_log(shader, false);
+			failed = true;
+		}
+	}
+
+	//check program:
 	GLint link_status = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
-	if (link_status != GL_TRUE) {
-		std::cerr << "Failed to link shader program." << std::endl;
-		GLint info_log_length = 0;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
-		std::vector< GLchar > info_log(info_log_length, 0);
-		GLsizei length = 0;
-		glGetProgramInfoLog(program, GLint(info_log.size()), &length, &info_log[0]);
-		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		throw std::runtime_error("failed to link program");
+	if (!failed) {
+		glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+		if (link_status != GL_TRUE) {
+			std::cerr << "Failed to link shader program '" << pending.name << "'." << std::endl;
+			print_info_log(program, true);
+			failed = true;
+		}
+	}
+	if (!pending.ready_known) pending.ready = now();
+
+	//shaders are reference counted so this makes sure they are freed after program is deleted:
+	if (pending.vertex_shader) glDeleteShader(pending.vertex_shader);
+	if (pending.fragment_shader) glDeleteShader(pending.fragment_shader);
+
+	if (failed) {
+		glDeleteProgram(program);
+		throw std::runtime_error("Failed to build shader program '" + pending.name + "'.");
+	}
+
+	if (!pending.name.empty()) {
+		std::cout << "Shader program '" << pending.name << "' " << (pending.vertex_shader ? "compiled" : "loaded from cache") << " in "
+			<< std::chrono::duration< double >(pending.ready - pending.submitted).count() * 1000.0 << " ms." << std::endl;
+	}
+
+	//save newly-compiled programs to the cache:
+	if (pending.vertex_shader && !pending.cache_file.empty()) {
+		save_cached_program(program, pending.key, pending.cache_file);
 	}
 
 	return program;
 }
+
+GLuint gl_compile_program(
+	std::string const &vertex_shader_source,
+	std::string const &fragment_shader_source,
+	std::string const &name
+	) {
+	return gl_finish_program(gl_submit_program(name, vertex_shader_source, fragment_shader_source));
+}
+
+bool gl_program_ready(GLuint program) {
+	auto &pending_programs = get_pending();
+	auto f = pending_programs.find(program);
+	if (f == pending_programs.end() || f->second.ready_known || !get_parallel().supported) return true;
+
+	GLint done = GL_FALSE;
+	glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+	if (done) {
+		f->second.ready = std::chrono::high_resolution_clock::now();
+		f->second.ready_known = true;
+	}
+	return done == GL_TRUE;
+}
+
+SubmittedProgram::SubmittedProgram(std::string const &name, std::string const &vertex_source, std::string const &fragment_source)
+	: SubmittedProgram(name, [vertex_source]() { return vertex_source; }, [fragment_source]() { return fragment_source; }) {
+}
+
+SubmittedProgram::SubmittedProgram(std::string const &name,
+	std::function< std::string() > const &vertex_source,
+	std::function< std::string() > const &fragment_source)
+	: submit(LoadTagShaders, [this, name, vertex_source, fragment_source]() {
+		program = gl_submit_program(name, vertex_source(), fragment_source());
+	}) {
+}
+
+GLuint SubmittedProgram::finish() {
+	if (program == 0) throw std::runtime_error("SubmittedProgram::finish() called before shaders were submitted.");
+	return gl_finish_program(program);
+}
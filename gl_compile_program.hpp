@@ -1,11 +1,54 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Load.hpp"
 
+#include <functional>
 #include <string>
 
-//compiles+links an OpenGL shader program from source.
+//starts compiling+linking a program without waiting for (or checking) the result,
+// so the driver can work on several programs at once (using KHR_parallel_shader_compile if available):
+// 'name' is used in error messages and in the compile time report printed by gl_finish_program.
+GLuint gl_submit_program(
+	std::string const &name,
+	std::string const &vertex_shader_source,
+	std::string const &fragment_shader_source);
+
+//waits for a submitted program and checks it (throws on compilation error); returns 'program':
+GLuint gl_finish_program(GLuint program);
+
+//returns true if gl_finish_program(program) won't have to wait
+// (always true without KHR_parallel_shader_compile, since there's no way to tell):
+bool gl_program_ready(GLuint program);
+
+//compiles+links an OpenGL shader program from source, waiting for the result.
 // throws on compilation error.
+// (same as gl_finish_program(gl_submit_program(...)), so it uses the binary cache;
+//  unnamed programs are cached by their source and left out of the compile time report)
 GLuint gl_compile_program(
 	std::string const &vertex_shader_source,
-	std::string const &fragment_shader_source);
+	std::string const &fragment_shader_source,
+	std::string const &name = "");
+
+//Programs should be submitted early (in LoadTagShaders), so they all compile in parallel before
+// anything needs them; a SubmittedProgram at global scope does this, and its finish() then waits for
+// and checks the result (e.g., in the constructor of a Load<> program struct):
+//  static SubmittedProgram submitted_program("MyProgram", vertex_source, fragment_source);
+//  ...
+//  program = submitted_program.finish();
+struct SubmittedProgram {
+	SubmittedProgram(std::string const &name, std::string const &vertex_source, std::string const &fragment_source);
+	//..or with sources that are only decided at load time (e.g., read from files):
+	SubmittedProgram(std::string const &name,
+		std::function< std::string() > const &vertex_source,
+		std::function< std::string() > const &fragment_source);
+
+	SubmittedProgram(SubmittedProgram const &) = delete;
+	SubmittedProgram &operator=(SubmittedProgram const &) = delete;
+
+	//wait for the program and check it (throws on compilation error); returns the program:
+	GLuint finish();
+
+	GLuint program = 0; //(zero until submitted)
+	Load< void > submit;
+};
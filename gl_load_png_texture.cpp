@@ -0,0 +1,96 @@
+#include "gl_load_png_texture.hpp"
+
+#include "load_save_png.hpp"
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+GLuint gl_load_png_texture(std::string const &filename, glm::uvec2 *size_, bool native_channels) {
+	//decode rows a batch at a time directly into a mapped pixel buffer, then copy each batch into the texture:
+	struct TextureSink : PNGRowSink {
+		GLuint tex = 0;
+		GLuint pbo = 0;
+		bool mapped = false;
+		glm::uvec2 size = glm::uvec2(0);
+		GLenum format = GL_RGBA;
+		size_t row_bytes = 0;
+
+		~TextureSink() {
+			if (mapped) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			}
+			if (pbo) glDeleteBuffers(1, &pbo);
+			if (tex) glDeleteTextures(1, &tex); //(only non-zero if loading didn't finish)
+		}
+
+		uint32_t header(glm::uvec2 size_, uint32_t channels) override {
+			size = size_;
+			row_bytes = size_t(size.x) * channels;
+
+			GLenum internal_format = GL_RGBA8;
+			if (channels == 1) { format = GL_RED; internal_format = GL_R8; }
+			else if (channels == 2) { format = GL_RG; internal_format = GL_RG8; }
+			else if (channels == 3) { format = GL_RGB; internal_format = GL_RGB8; }
+
+			glGenTextures(1, &tex);
+			glBindTexture(GL_TEXTURE_2D, tex);
+			glTexImage2D(GL_TEXTURE_2D, 0, GLint(internal_format), GLsizei(size.x), GLsizei(size.y), 0, format, GL_UNSIGNED_BYTE, nullptr);
+			//gray (+alpha) should read as gray (+alpha) in shaders:
+			if (channels == 1) {
+				GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+				glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+			} else if (channels == 2) {
+				GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+				glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glGenBuffers(1, &pbo);
+			GL_ERRORS();
+
+			//batches of about 256k:
+			return uint32_t(std::max< size_t >(1, (256 * 1024) / std::max< size_t >(1, row_bytes)));
+		}
+
+		uint8_t *begin_rows(uint32_t, uint32_t count) override {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			//(orphan the previous batch's storage so mapping doesn't wait for its upload to finish)
+			GLsizeiptr bytes = GLsizeiptr(row_bytes * count);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+			void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			if (!ptr) throw std::runtime_error("Failed to map pixel buffer for texture upload.");
+			mapped = true;
+			return reinterpret_cast< uint8_t * >(ptr);
+		}
+
+		void end_rows(uint32_t y, uint32_t count) override {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			mapped = false;
+
+			glBindTexture(GL_TEXTURE_2D, tex);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //(rows of 1- and 3-channel images aren't 4-byte aligned)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(y), GLsizei(size.x), GLsizei(count), format, GL_UNSIGNED_BYTE, 0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			GL_ERRORS();
+		}
+	} sink;
+
+	load_png_rows(filename, sink, LowerLeftOrigin, native_channels);
+
+	if (size_) *size_ = sink.size;
+	GLuint tex = sink.tex;
+	sink.tex = 0; //(so sink doesn't delete it)
+	return tex;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+
+//loads a PNG file into a new GL_TEXTURE_2D (lower-left origin, no mipmaps), streaming decoded rows through a pixel buffer object.
+// the file's own channel count is kept (GL_R8, GL_RG8, GL_RGB8, or GL_RGBA8; gray textures are swizzled to read as gray)
+// unless 'native_channels' is false, in which case the texture is always GL_RGBA8.
+// throws on error.
+GLuint gl_load_png_texture(std::string const &filename, glm::uvec2 *size = nullptr, bool native_channels = true);
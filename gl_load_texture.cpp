@@ -0,0 +1,82 @@
+#include "gl_load_texture.hpp"
+
+#include "load_save_texture.hpp"
+#include "gl_errors.hpp"
+
+#include <cstring>
+#include <iostream>
+
+//S3TC formats aren't part of core OpenGL 3.3 (so aren't in GL.hpp); these are from EXT_texture_compression_s3tc:
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT  0x83F3
+#endif
+
+static bool have_s3tc() {
+	static int cached = -1;
+	if (cached == -1) {
+		cached = 0;
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i) {
+			char const *name = reinterpret_cast< char const * >(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+			if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+				cached = 1;
+				break;
+			}
+		}
+		if (!cached) {
+			std::cerr << "WARNING: GL_EXT_texture_compression_s3tc isn't available; compressed textures will be decompressed at load time." << std::endl;
+		}
+	}
+	return cached == 1;
+}
+
+GLuint gl_load_texture(std::string const &filename, glm::uvec2 *size) {
+	TextureData texture;
+	load_texture(filename, &texture);
+
+	bool compressed = (texture.header.format != TextureData::RGBA8 && have_s3tc());
+
+	GLuint tex = 0;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (uint32_t l = 0; l < texture.levels.size(); ++l) {
+		TextureData::LevelInfo const &level = texture.levels[l];
+		if (compressed) {
+			GLenum format = (texture.header.format == TextureData::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+			glCompressedTexImage2D(GL_TEXTURE_2D, GLint(l), format, GLsizei(level.width), GLsizei(level.height), 0,
+				GLsizei(level.end - level.begin), texture.data.data() + level.begin);
+		} else if (texture.header.format == TextureData::RGBA8) {
+			glTexImage2D(GL_TEXTURE_2D, GLint(l), GL_RGBA8, GLsizei(level.width), GLsizei(level.height), 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, texture.data.data() + level.begin);
+		} else {
+			std::vector< glm::u8vec4 > pixels = decompress_level(texture, l);
+			glTexImage2D(GL_TEXTURE_2D, GLint(l), GL_RGBA8, GLsizei(level.width), GLsizei(level.height), 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(texture.levels.size() - 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (texture.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GL_ERRORS();
+
+	if (size) *size = glm::uvec2(texture.header.width, texture.header.height);
+	return tex;
+}
+
+void gl_load_texture(std::string const &filename, Scene::Drawable::Pipeline::TextureInfo *slot) {
+	assert(slot);
+	slot->texture = gl_load_texture(filename);
+	slot->target = GL_TEXTURE_2D;
+}
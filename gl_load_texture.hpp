@@ -0,0 +1,16 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+
+//loads a texture file made by 'texture-pack' (see load_save_texture.hpp) into a new GL_TEXTURE_2D, including its mip chain.
+// BC1/BC3 levels are uploaded as-is when the GL has S3TC support (and decompressed on the CPU when it doesn't).
+// throws on error.
+GLuint gl_load_texture(std::string const &filename, glm::uvec2 *size = nullptr);
+
+//...and put it into a pipeline's texture slot:
+void gl_load_texture(std::string const &filename, Scene::Drawable::Pipeline::TextureInfo *slot);
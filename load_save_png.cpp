@@ -1,10 +1,17 @@
 #include "load_save_png.hpp"
 
 #include <png.h>
+#include <zlib.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 #define LOG_ERROR( X ) std::cerr << X << std::endl
@@ -12,6 +19,7 @@
 using std::vector;
 
 bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin);
+bool load_png_rows(std::istream &from, PNGRowSink &sink, OriginLocation origin, bool native_channels);
 void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin);
 
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
@@ -26,6 +34,16 @@ void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 >
 	}
 }
 
+void load_png_rows(std::string filename, PNGRowSink &sink, OriginLocation origin, bool native_channels) {
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
+	}
+	if (!load_png_rows(file, sink, origin, native_channels)) {
+		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
+	}
+}
+
 void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin) {
 	std::ofstream file(filename.c_str(), std::ios::binary);
 	save_png(file, size.x, size.y, data, origin);
@@ -57,77 +75,140 @@ static void user_flush_data(png_structp png_ptr) {
 }
 
 
-bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin) {
-	assert(data);
-	uint32_t local_width, local_height;
-	if (width == nullptr) width = &local_width;
-	if (height == nullptr) height = &local_height;
-	*width = *height = 0;
-	data->clear();
+//decode rows into memory supplied by 'sink' (called from load_png_rows, below, inside its setjmp() context):
+// (no locals with destructors here, since libpng errors longjmp() out of this function)
+static void read_png_rows(png_structp png, png_infop info, PNGRowSink &sink, OriginLocation origin, bool native_channels, vector< uint8_t > &interlaced) {
+	png_read_info(png, info);
+	unsigned int w = png_get_image_width(png, info);
+	unsigned int h = png_get_image_height(png, info);
+	png_byte color_type = png_get_color_type(png, info);
+	png_byte bit_depth = png_get_bit_depth(png, info);
+
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
+	if (native_channels) {
+		if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+			png_set_expand_gray_1_2_4_to_8(png);
+		if (png_get_valid(png, info, PNG_INFO_tRNS))
+			png_set_tRNS_to_alpha(png);
+	} else {
+		if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+			png_set_gray_to_rgb(png);
+		if (!(color_type & PNG_COLOR_MASK_ALPHA))
+			png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+	}
+	if (bit_depth < 8)
+		png_set_packing(png);
+	if (bit_depth == 16)
+		png_set_strip_16(png);
+	int passes = png_set_interlace_handling(png);
+	//Ok, should be 8 bits per channel now.
+
+	png_read_update_info(png, info);
+	uint32_t channels = png_get_channels(png, info);
+	size_t rowbytes = png_get_rowbytes(png, info);
+	//Make sure it's the format we think it is...
+	assert(rowbytes == size_t(w) * channels);
+	assert(native_channels || channels == 4);
+
+	uint32_t batch = std::max(1u, sink.header(glm::uvec2(w, h), channels));
+
+	if (passes > 1) {
+		//interlaced images revisit every row on each pass, so decode the whole image first:
+		interlaced.resize(rowbytes * h);
+		for (int pass = 0; pass < passes; ++pass) {
+			for (unsigned int r = 0; r < h; ++r) {
+				png_read_row(png, &interlaced[r * rowbytes], NULL);
+			}
+		}
+	}
+
+	for (unsigned int r0 = 0; r0 < h; r0 += batch) {
+		uint32_t count = std::min(batch, h - r0);
+		uint32_t y = (origin == UpperLeftOrigin ? r0 : h - r0 - count);
+		uint8_t *rows = sink.begin_rows(y, count);
+		for (uint32_t i = 0; i < count; ++i) {
+			uint8_t *row = rows + rowbytes * (origin == UpperLeftOrigin ? i : count - 1 - i);
+			if (passes > 1) {
+				std::memcpy(row, &interlaced[(r0 + i) * rowbytes], rowbytes);
+			} else {
+				png_read_row(png, row, NULL);
+			}
+		}
+		sink.end_rows(y, count);
+	}
+}
+
+bool load_png_rows(std::istream &from, PNGRowSink &sink, OriginLocation origin, bool native_channels) {
 	//..... load file ......
 	//Load a png file, as per the libpng docs:
 	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
-
-	png_set_read_fn(png, &from, user_read_data);
-
 	if (!png) {
 		LOG_ERROR("  cannot alloc read struct.");
 		return false;
 	}
+
+	png_set_read_fn(png, &from, user_read_data);
+
 	png_infop info = png_create_info_struct(png);
 	if (!info) {
 		LOG_ERROR("  cannot alloc info struct.");
 		png_destroy_read_struct(&png, (png_infopp)NULL, (png_infopp)NULL);
 		return false;
 	}
-	png_bytep *row_pointers = NULL;
+	vector< uint8_t > interlaced; //(only used for interlaced images)
 	if (setjmp(png_jmpbuf(png))) {
 		LOG_ERROR("  png interal error.");
 		png_destroy_read_struct(&png, &info, (png_infopp)NULL);
-		if (row_pointers != NULL) delete[] row_pointers;
-		data->clear();
 		return false;
 	}
 	//not needed with custom read/write functions: png_init_io(png, NULL);
-	png_read_info(png, info);
-	unsigned int w = png_get_image_width(png, info);
-	unsigned int h = png_get_image_height(png, info);
-	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE)
-		png_set_palette_to_rgb(png);
-	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY || png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA)
-		png_set_gray_to_rgb(png);
-	if (!(png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA))
-		png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
-	if (png_get_bit_depth(png, info) < 8)
-		png_set_packing(png);
-	if (png_get_bit_depth(png,info) == 16)
-		png_set_strip_16(png);
-	//Ok, should be 32-bit RGBA now.
+	try {
+		read_png_rows(png, info, sink, origin, native_channels, interlaced);
+	} catch (...) {
+		//(exceptions thrown by the sink)
+		png_destroy_read_struct(&png, &info, NULL);
+		throw;
+	}
+	png_destroy_read_struct(&png, &info, NULL);
+	return true;
+}
 
-	png_read_update_info(png, info);
-	size_t rowbytes = png_get_rowbytes(png, info);
-	//Make sure it's the format we think it is...
-	assert(rowbytes == w*sizeof(uint32_t));
+bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin) {
+	assert(data);
+	uint32_t local_width, local_height;
+	if (width == nullptr) width = &local_width;
+	if (height == nullptr) height = &local_height;
+	*width = *height = 0;
+	data->clear();
 
-	data->resize(w*h);
-	row_pointers = new png_bytep[h];
-	for (unsigned int r = 0; r < h; ++r) {
-		if (origin == LowerLeftOrigin) {
-			row_pointers[h-1-r] = (png_bytep)(&(*data)[r*w]);
-		} else {
-			row_pointers[r] = (png_bytep)(&(*data)[r*w]);
+	//decode straight into 'data' as one batch:
+	struct VectorSink : PNGRowSink {
+		VectorSink(vector< glm::u8vec4 > *data_) : data(data_) { }
+		vector< glm::u8vec4 > *data;
+		glm::uvec2 size = glm::uvec2(0);
+		uint32_t header(glm::uvec2 size_, uint32_t channels) override {
+			assert(channels == 4);
+			size = size_;
+			data->resize(size_t(size.x) * size.y);
+			return size.y;
 		}
+		uint8_t *begin_rows(uint32_t y, uint32_t) override {
+			return reinterpret_cast< uint8_t * >(data->data() + size_t(y) * size.x);
+		}
+		void end_rows(uint32_t, uint32_t) override { }
+	} sink(data);
+
+	if (!load_png_rows(from, sink, origin, false)) {
+		data->clear();
+		return false;
 	}
-	png_read_image(png, row_pointers);
-	png_destroy_read_struct(&png, &info, NULL);
-	delete[] row_pointers;
 
-	*width = w;
-	*height = h;
+	*width = sink.size.x;
+	*height = sink.size.y;
 	return true;
 }
 
-
 void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin) {
 //After the libpng example.c
 	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -173,3 +254,245 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8
 
 	return;
 }
+
+
+//------------------------------------------------
+//Multi-threaded encoder (after pigz):
+// - rows are filtered in parallel
+// - the filtered data is split into strips which are deflated in parallel as raw deflate streams;
+//   each strip starts with the previous 32k of data as a dictionary (so compression barely suffers)
+//   and ends with a sync flush (so the strips can be concatenated)
+// - strip checksums are combined into the zlib stream's adler32
+
+//run fn(0) ... fn(count-1) on up to 'threads' threads:
+template< typename F >
+static void parallel_for(uint32_t count, uint32_t threads, F const &fn) {
+	threads = std::max(1u, std::min(threads, count));
+	if (threads == 1) {
+		for (uint32_t i = 0; i < count; ++i) fn(i);
+		return;
+	}
+	std::atomic< uint32_t > next(0);
+	auto work = [&]() {
+		for (uint32_t i = next++; i < count; i = next++) fn(i);
+	};
+	std::vector< std::thread > pool;
+	for (uint32_t t = 1; t < threads; ++t) pool.emplace_back(work);
+	work();
+	for (auto &t : pool) t.join();
+}
+
+static inline uint8_t paeth_predictor(uint8_t a, uint8_t b, uint8_t c) {
+	int p = int(a) + int(b) - int(c);
+	int pa = std::abs(p - int(a));
+	int pb = std::abs(p - int(b));
+	int pc = std::abs(p - int(c));
+	if (pa <= pb && pa <= pc) return a;
+	else if (pb <= pc) return b;
+	else return c;
+}
+
+//apply PNG filter 'type' (1-4 == Sub, Up, Average, Paeth; 0 == None) to 'row' of RGBA8 pixels; 'prev' is the row above (all zeros for the first row):
+static void filter_row(uint32_t type, uint8_t const *row, uint8_t const *prev, size_t bytes, uint8_t *out) {
+	constexpr size_t const bpp = 4;
+	switch (type) {
+	case 0:
+		std::copy(row, row + bytes, out);
+		break;
+	case 1:
+		for (size_t i = 0; i < bpp; ++i) out[i] = row[i];
+		for (size_t i = bpp; i < bytes; ++i) out[i] = uint8_t(row[i] - row[i-bpp]);
+		break;
+	case 2:
+		for (size_t i = 0; i < bytes; ++i) out[i] = uint8_t(row[i] - prev[i]);
+		break;
+	case 3:
+		for (size_t i = 0; i < bpp; ++i) out[i] = uint8_t(row[i] - (prev[i] >> 1));
+		for (size_t i = bpp; i < bytes; ++i) out[i] = uint8_t(row[i] - ((uint32_t(row[i-bpp]) + uint32_t(prev[i])) >> 1));
+		break;
+	case 4:
+		for (size_t i = 0; i < bpp; ++i) out[i] = uint8_t(row[i] - paeth_predictor(0, prev[i], 0));
+		for (size_t i = bpp; i < bytes; ++i) out[i] = uint8_t(row[i] - paeth_predictor(row[i-bpp], prev[i], prev[i-bpp]));
+		break;
+	default:
+		assert(0 && "unknown filter type");
+	}
+}
+
+void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin, PNGSaveOptions const &options) {
+	if (size.x == 0 || size.y == 0) {
+		throw std::runtime_error("Can't save empty (" + std::to_string(size.x) + "x" + std::to_string(size.y) + ") image to '" + filename + "'.");
+	}
+	if (options.level < 0 || options.level > 9) {
+		throw std::runtime_error("PNG compression level " + std::to_string(options.level) + " isn't in [0,9].");
+	}
+
+	uint32_t threads = options.threads;
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+	size_t const row_bytes = size_t(size.x) * 4;
+	size_t const line_bytes = 1 + row_bytes; //filter type + row
+	auto row = [&](uint32_t y) -> uint8_t const * {
+		return reinterpret_cast< uint8_t const * >(data + size_t(origin == UpperLeftOrigin ? y : size.y - 1 - y) * size.x);
+	};
+
+	//strips of at least 256k (or fewer if that leaves threads idle):
+	uint32_t rows_per_strip = uint32_t(std::max< size_t >(1, (256 * 1024 + line_bytes - 1) / line_bytes));
+	rows_per_strip = std::min(rows_per_strip, std::max(1u, (size.y + threads - 1) / threads));
+	uint32_t const strips = (size.y + rows_per_strip - 1) / rows_per_strip;
+
+	//(1) filter:
+	std::vector< uint8_t > filtered(line_bytes * size.y);
+	std::vector< uint8_t > const zeros(row_bytes, 0);
+	parallel_for(size.y, threads, [&](uint32_t y) {
+		uint8_t const *cur = row(y);
+		uint8_t const *prev = (y == 0 ? zeros.data() : row(y - 1));
+		uint8_t *out = &filtered[line_bytes * y];
+
+		uint32_t type = 0;
+		if (options.filter == PNGSaveOptions::FilterAdaptive) {
+			//pick the filter with the smallest sum of absolute (signed) values:
+			static thread_local std::vector< uint8_t > trial;
+			trial.resize(row_bytes);
+			uint64_t best = uint64_t(-1);
+			for (uint32_t t = 0; t <= 4; ++t) {
+				filter_row(t, cur, prev, row_bytes, trial.data());
+				uint64_t score = 0;
+				for (uint8_t b : trial) score += uint64_t(std::abs(int(int8_t(b))));
+				if (score < best) {
+					best = score;
+					type = t;
+					std::copy(trial.begin(), trial.end(), out + 1);
+				}
+			}
+		} else {
+			type = uint32_t(options.filter);
+			filter_row(type, cur, prev, row_bytes, out + 1);
+		}
+		out[0] = uint8_t(type);
+	});
+
+	//(2) deflate strips:
+	struct Strip {
+		std::vector< uint8_t > deflated;
+		uLong adler = 0;
+		size_t length = 0;
+		std::string error;
+	};
+	std::vector< Strip > strip_data(strips);
+	parallel_for(strips, threads, [&](uint32_t s) {
+		Strip &strip = strip_data[s];
+		size_t begin = line_bytes * size_t(s) * rows_per_strip;
+		size_t end = std::min(filtered.size(), line_bytes * size_t(s + 1) * rows_per_strip);
+		strip.length = end - begin;
+		strip.adler = adler32(adler32(0L, Z_NULL, 0), &filtered[begin], uInt(strip.length));
+
+		z_stream zs;
+		zs.zalloc = Z_NULL;
+		zs.zfree = Z_NULL;
+		zs.opaque = Z_NULL;
+		//(negative window bits == raw deflate stream, no header or checksum)
+		int strategy = (options.filter == PNGSaveOptions::FilterNone ? Z_DEFAULT_STRATEGY : Z_FILTERED);
+		if (deflateInit2(&zs, options.level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+			strip.error = "deflateInit2 failed";
+			return;
+		}
+		if (begin > 0) {
+			size_t dict = std::min< size_t >(begin, 32768);
+			deflateSetDictionary(&zs, &filtered[begin - dict], uInt(dict));
+		}
+
+		strip.deflated.resize(deflateBound(&zs, uLong(strip.length)) + 64);
+		zs.next_in = &filtered[begin];
+		zs.avail_in = uInt(strip.length);
+		zs.next_out = strip.deflated.data();
+		zs.avail_out = uInt(strip.deflated.size());
+		int flush = (s + 1 == strips ? Z_FINISH : Z_SYNC_FLUSH);
+		while (true) {
+			int ret = deflate(&zs, flush);
+			if (ret == Z_STREAM_ERROR) {
+				strip.error = "deflate failed";
+				break;
+			}
+			if (zs.avail_out != 0) break; //all output written
+			//(out of output space -- shouldn't happen given deflateBound, but grow and continue just in case)
+			size_t used = strip.deflated.size();
+			strip.deflated.resize(used * 2);
+			zs.next_out = strip.deflated.data() + used;
+			zs.avail_out = uInt(strip.deflated.size() - used);
+		}
+		strip.deflated.resize(zs.total_out);
+		deflateEnd(&zs);
+	});
+
+	uLong adler = adler32(0L, Z_NULL, 0);
+	for (Strip const &strip : strip_data) {
+		if (!strip.error.empty()) {
+			throw std::runtime_error("Failed to compress PNG data for '" + filename + "': " + strip.error + ".");
+		}
+		adler = adler32_combine(adler, strip.adler, z_off_t(strip.length));
+	}
+
+	//(3) write out PNG:
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+
+	auto be32 = [](uint32_t v, uint8_t *out) {
+		out[0] = uint8_t(v >> 24); out[1] = uint8_t(v >> 16); out[2] = uint8_t(v >> 8); out[3] = uint8_t(v);
+	};
+	//write a chunk whose data is the concatenation of 'parts':
+	auto write_chunk = [&](char const *type, std::vector< std::pair< uint8_t const *, size_t > > const &parts) {
+		size_t length = 0;
+		uLong crc = crc32(0L, reinterpret_cast< Bytef const * >(type), 4);
+		for (auto const &part : parts) {
+			length += part.second;
+			crc = crc32(crc, part.first, uInt(part.second));
+		}
+		uint8_t buf[4];
+		be32(uint32_t(length), buf);
+		file.write(reinterpret_cast< char const * >(buf), 4);
+		file.write(type, 4);
+		for (auto const &part : parts) {
+			file.write(reinterpret_cast< char const * >(part.first), std::streamsize(part.second));
+		}
+		be32(uint32_t(crc), buf);
+		file.write(reinterpret_cast< char const * >(buf), 4);
+	};
+
+	static uint8_t const signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	file.write(reinterpret_cast< char const * >(signature), 8);
+
+	uint8_t ihdr[13];
+	be32(size.x, ihdr + 0);
+	be32(size.y, ihdr + 4);
+	ihdr[8] = 8; //bit depth
+	ihdr[9] = 6; //color type: RGBA
+	ihdr[10] = 0; //compression: deflate
+	ihdr[11] = 0; //filter method: adaptive (per-row filter types)
+	ihdr[12] = 0; //no interlace
+	write_chunk("IHDR", {{ihdr, 13}});
+
+	//zlib header (32k window, deflate, level hint, no dictionary):
+	uint8_t zlib_header[2];
+	zlib_header[0] = 0x78;
+	zlib_header[1] = uint8_t((options.level < 2 ? 0 : options.level < 6 ? 1 : options.level == 6 ? 2 : 3) << 6);
+	zlib_header[1] = uint8_t(zlib_header[1] + (31 - (zlib_header[0] * 256 + zlib_header[1]) % 31) % 31);
+	uint8_t zlib_trailer[4];
+	be32(uint32_t(adler), zlib_trailer);
+
+	//one IDAT per strip (the zlib stream may be split across IDATs anywhere):
+	for (uint32_t s = 0; s < strips; ++s) {
+		std::vector< std::pair< uint8_t const *, size_t > > parts;
+		if (s == 0) parts.emplace_back(zlib_header, 2);
+		parts.emplace_back(strip_data[s].deflated.data(), strip_data[s].deflated.size());
+		if (s + 1 == strips) parts.emplace_back(zlib_trailer, 4);
+		write_chunk("IDAT", parts);
+	}
+	write_chunk("IEND", {});
+
+	if (!file) {
+		throw std::runtime_error("Failed to write PNG to '" + filename + "'.");
+	}
+}
@@ -17,4 +17,46 @@ enum OriginLocation {
 
 //NOTE: load_png will throw on error
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
+
+//Streaming loader: decodes rows straight into memory supplied (a batch at a time) by a sink,
+// so the image doesn't need to be held in memory as a whole (e.g., the sink can hand out a mapped pixel buffer):
+struct PNGRowSink {
+	virtual ~PNGRowSink() { }
+	//called once before any rows, with the image size and channels per pixel
+	// (1 == gray, 2 == gray+alpha, 3 == RGB, 4 == RGBA; always 4 unless native channels were requested):
+	// returns the number of rows per batch
+	virtual uint32_t header(glm::uvec2 size, uint32_t channels) = 0;
+	//return space for rows [y, y+count) (tightly packed, 'channels' bytes per pixel, in order of increasing y):
+	virtual uint8_t *begin_rows(uint32_t y, uint32_t count) = 0;
+	//rows [y, y+count) have been filled in:
+	virtual void end_rows(uint32_t y, uint32_t count) = 0;
+};
+
+//NOTE: load_png_rows will throw on error
+// (batches arrive in file order: top-to-bottom, so with LowerLeftOrigin y decreases from batch to batch)
+// if native_channels is false, pixels are expanded to RGBA (like load_png)
+void load_png_rows(std::string filename, PNGRowSink &sink, OriginLocation origin, bool native_channels);
 void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin);
+
+//Options for the multi-threaded encoder:
+// (the image is split into strips of rows that are filtered and compressed in parallel, then
+//  stitched into one zlib stream -- the output is an ordinary PNG)
+struct PNGSaveOptions {
+	int level = 6; //zlib compression level (0 == store, 1 == fastest, 9 == smallest)
+	enum Filter {
+		FilterNone, FilterSub, FilterUp, FilterAverage, FilterPaeth, //same filter for every row
+		FilterAdaptive, //per-row choice (minimum sum of absolute differences, like libpng)
+	} filter = FilterAdaptive;
+	uint32_t threads = 0; //0 == one per core
+
+	//good for captures (roughly 2x larger files than the default, but much quicker):
+	static PNGSaveOptions fast() {
+		PNGSaveOptions ret;
+		ret.level = 1;
+		ret.filter = FilterUp;
+		return ret;
+	}
+};
+
+//NOTE: save_png with options will throw on error
+void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin, PNGSaveOptions const &options);
@@ -0,0 +1,376 @@
+#include "load_save_texture.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+void load_texture(std::string const &filename, TextureData *texture_) {
+	assert(texture_);
+	TextureData &texture = *texture_;
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open texture file '" + filename + "'.");
+	}
+
+	std::vector< TextureData::Header > header;
+	read_chunk(file, "tex0", &header);
+	if (header.size() != 1) {
+		throw std::runtime_error("Texture '" + filename + "' should have exactly one header.");
+	}
+	texture.header = header[0];
+	if (texture.header.format != TextureData::RGBA8 && texture.header.format != TextureData::BC1 && texture.header.format != TextureData::BC3) {
+		throw std::runtime_error("Texture '" + filename + "' has unknown format " + std::to_string(uint32_t(texture.header.format)) + ".");
+	}
+
+	read_chunk(file, "mip0", &texture.levels);
+	read_chunk(file, "dat0", &texture.data);
+
+	if (texture.levels.size() != texture.header.levels || texture.levels.empty()) {
+		throw std::runtime_error("Texture '" + filename + "' has a mismatched level count.");
+	}
+	for (auto const &level : texture.levels) {
+		if (level.begin > level.end || level.end > texture.data.size()
+		 || level.end - level.begin != texture_level_bytes(texture.header.format, level.width, level.height)) {
+			throw std::runtime_error("Texture '" + filename + "' has a level with a bad data range.");
+		}
+	}
+}
+
+void save_texture(std::string const &filename, TextureData const &texture) {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+	write_chunk("tex0", std::vector< TextureData::Header >(1, texture.header), &file);
+	write_chunk("mip0", texture.levels, &file);
+	write_chunk("dat0", texture.data, &file);
+	if (!file) {
+		throw std::runtime_error("Failed to write texture to '" + filename + "'.");
+	}
+}
+
+uint32_t texture_level_bytes(TextureData::Format format, uint32_t width, uint32_t height) {
+	if (format == TextureData::RGBA8) return width * height * 4;
+	uint32_t blocks = ((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == TextureData::BC1 ? 8 : 16);
+}
+
+//------------------------------------------------
+//S3TC block helpers:
+
+static uint16_t pack_565(glm::vec3 const &c) {
+	uint32_t r = uint32_t(std::max(0.0f, std::min(31.0f, c.x * (31.0f / 255.0f) + 0.5f)));
+	uint32_t g = uint32_t(std::max(0.0f, std::min(63.0f, c.y * (63.0f / 255.0f) + 0.5f)));
+	uint32_t b = uint32_t(std::max(0.0f, std::min(31.0f, c.z * (31.0f / 255.0f) + 0.5f)));
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static glm::vec3 unpack_565(uint16_t c) {
+	uint32_t r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+	//(replicate high bits into low bits, as hardware does)
+	return glm::vec3(float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2)));
+}
+
+static float distance2(glm::vec3 const &a, glm::vec3 const &b) {
+	glm::vec3 d = a - b;
+	return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+//choose the nearest of the four palette colors for each pixel; returns total squared error:
+static float pick_color_indices(glm::vec3 const px[16], uint16_t c0, uint16_t c1, uint32_t *indices) {
+	glm::vec3 palette[4];
+	palette[0] = unpack_565(c0);
+	palette[1] = unpack_565(c1);
+	palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+	palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+
+	float error = 0.0f;
+	*indices = 0;
+	for (uint32_t i = 0; i < 16; ++i) {
+		uint32_t best = 0;
+		float best_d = distance2(px[i], palette[0]);
+		for (uint32_t p = 1; p < 4; ++p) {
+			float d = distance2(px[i], palette[p]);
+			if (d < best_d) {
+				best_d = d;
+				best = p;
+			}
+		}
+		*indices |= best << (2 * i);
+		error += best_d;
+	}
+	return error;
+}
+
+//encode 16 colors as a 4-color-mode BC1 block:
+static void encode_color_block(glm::u8vec4 const block[16], uint8_t *out) {
+	glm::vec3 px[16];
+	glm::vec3 mean = glm::vec3(0.0f);
+	for (uint32_t i = 0; i < 16; ++i) {
+		px[i] = glm::vec3(float(block[i].r), float(block[i].g), float(block[i].b));
+		mean += px[i];
+	}
+	mean /= 16.0f;
+
+	//principal axis of the colors (power iteration on the covariance matrix):
+	float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}; //xx xy xz yy yz zz
+	for (uint32_t i = 0; i < 16; ++i) {
+		glm::vec3 d = px[i] - mean;
+		cov[0] += d.x * d.x; cov[1] += d.x * d.y; cov[2] += d.x * d.z;
+		cov[3] += d.y * d.y; cov[4] += d.y * d.z; cov[5] += d.z * d.z;
+	}
+	glm::vec3 axis = glm::vec3(1.0f, 1.0f, 1.0f);
+	for (uint32_t iter = 0; iter < 8; ++iter) {
+		glm::vec3 next = glm::vec3(
+			cov[0] * axis.x + cov[1] * axis.y + cov[2] * axis.z,
+			cov[1] * axis.x + cov[3] * axis.y + cov[4] * axis.z,
+			cov[2] * axis.x + cov[4] * axis.y + cov[5] * axis.z
+		);
+		float len = std::max(std::abs(next.x), std::max(std::abs(next.y), std::abs(next.z)));
+		if (len < 1e-6f) break; //(flat block)
+		axis = next / len;
+	}
+
+	//endpoints at the extremes along the axis:
+	float t_min = 0.0f, t_max = 0.0f;
+	float axis2 = axis.x * axis.x + axis.y * axis.y + axis.z * axis.z;
+	for (uint32_t i = 0; i < 16; ++i) {
+		glm::vec3 d = px[i] - mean;
+		float t = (d.x * axis.x + d.y * axis.y + d.z * axis.z) / axis2;
+		t_min = std::min(t_min, t);
+		t_max = std::max(t_max, t);
+	}
+	uint16_t c0 = pack_565(mean + axis * t_max);
+	uint16_t c1 = pack_565(mean + axis * t_min);
+
+	uint32_t indices = 0;
+	float error = pick_color_indices(px, c0, c1, &indices);
+
+	{ //refine endpoints with a least-squares fit to the chosen indices:
+		static float const weight[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f}; //weight of endpoint 0 for each index
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		glm::vec3 ax = glm::vec3(0.0f), bx = glm::vec3(0.0f);
+		for (uint32_t i = 0; i < 16; ++i) {
+			float a = weight[(indices >> (2 * i)) & 3];
+			float b = 1.0f - a;
+			aa += a * a; ab += a * b; bb += b * b;
+			ax += a * px[i]; bx += b * px[i];
+		}
+		float det = aa * bb - ab * ab;
+		if (std::abs(det) > 1e-6f) {
+			glm::vec3 e0 = (ax * bb - bx * ab) / det;
+			glm::vec3 e1 = (bx * aa - ax * ab) / det;
+			uint16_t r0 = pack_565(e0), r1 = pack_565(e1);
+			uint32_t r_indices = 0;
+			float r_error = pick_color_indices(px, r0, r1, &r_indices);
+			if (r_error < error) {
+				c0 = r0;
+				c1 = r1;
+				indices = r_indices;
+				error = r_error;
+			}
+		}
+	}
+
+	//c0 > c1 selects 4-color mode:
+	if (c0 < c1) {
+		std::swap(c0, c1);
+		indices ^= 0x55555555; //swaps 0 <-> 1 and 2 <-> 3
+	} else if (c0 == c1) {
+		indices = 0;
+	}
+
+	out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+	out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+	out[4] = uint8_t(indices); out[5] = uint8_t(indices >> 8); out[6] = uint8_t(indices >> 16); out[7] = uint8_t(indices >> 24);
+}
+
+//encode 16 alphas as a BC3 alpha block:
+static void encode_alpha_block(glm::u8vec4 const block[16], uint8_t *out) {
+	uint8_t a0 = 0, a1 = 255;
+	for (uint32_t i = 0; i < 16; ++i) {
+		a0 = std::max(a0, block[i].a);
+		a1 = std::min(a1, block[i].a);
+	}
+
+	//a0 > a1 selects the 8-value palette:
+	uint32_t palette[8] = {a0, a1};
+	for (uint32_t p = 1; p < 7; ++p) {
+		palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+	}
+
+	uint64_t indices = 0;
+	if (a0 != a1) {
+		for (uint32_t i = 0; i < 16; ++i) {
+			uint32_t best = 0;
+			uint32_t best_d = 256;
+			for (uint32_t p = 0; p < 8; ++p) {
+				uint32_t d = uint32_t(std::abs(int(block[i].a) - int(palette[p])));
+				if (d < best_d) {
+					best_d = d;
+					best = p;
+				}
+			}
+			indices |= uint64_t(best) << (3 * i);
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (uint32_t b = 0; b < 6; ++b) {
+		out[2 + b] = uint8_t(indices >> (8 * b));
+	}
+}
+
+static void decode_color_block(uint8_t const *in, bool allow_3_color, glm::u8vec4 *block) {
+	uint16_t c0 = uint16_t(in[0] | (in[1] << 8));
+	uint16_t c1 = uint16_t(in[2] | (in[3] << 8));
+	uint32_t indices = uint32_t(in[4]) | (uint32_t(in[5]) << 8) | (uint32_t(in[6]) << 16) | (uint32_t(in[7]) << 24);
+
+	glm::vec3 p0 = unpack_565(c0), p1 = unpack_565(c1);
+	glm::u8vec4 palette[4];
+	palette[0] = glm::u8vec4(uint8_t(p0.x), uint8_t(p0.y), uint8_t(p0.z), 0xff);
+	palette[1] = glm::u8vec4(uint8_t(p1.x), uint8_t(p1.y), uint8_t(p1.z), 0xff);
+	if (c0 > c1 || !allow_3_color) {
+		glm::vec3 p2 = (2.0f * p0 + p1) / 3.0f + 0.5f;
+		glm::vec3 p3 = (p0 + 2.0f * p1) / 3.0f + 0.5f;
+		palette[2] = glm::u8vec4(uint8_t(p2.x), uint8_t(p2.y), uint8_t(p2.z), 0xff);
+		palette[3] = glm::u8vec4(uint8_t(p3.x), uint8_t(p3.y), uint8_t(p3.z), 0xff);
+	} else {
+		glm::vec3 p2 = (p0 + p1) / 2.0f + 0.5f;
+		palette[2] = glm::u8vec4(uint8_t(p2.x), uint8_t(p2.y), uint8_t(p2.z), 0xff);
+		palette[3] = glm::u8vec4(0x00);
+	}
+	for (uint32_t i = 0; i < 16; ++i) {
+		block[i] = palette[(indices >> (2 * i)) & 3];
+	}
+}
+
+static void decode_alpha_block(uint8_t const *in, glm::u8vec4 *block) {
+	uint32_t a0 = in[0], a1 = in[1];
+	uint32_t palette[8] = {a0, a1};
+	if (a0 > a1) {
+		for (uint32_t p = 1; p < 7; ++p) palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+	} else {
+		for (uint32_t p = 1; p < 5; ++p) palette[p + 1] = ((5 - p) * a0 + p * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	uint64_t indices = 0;
+	for (uint32_t b = 0; b < 6; ++b) {
+		indices |= uint64_t(in[2 + b]) << (8 * b);
+	}
+	for (uint32_t i = 0; i < 16; ++i) {
+		block[i].a = uint8_t(palette[(indices >> (3 * i)) & 7]);
+	}
+}
+
+//------------------------------------------------
+
+TextureData make_texture(glm::uvec2 size, std::vector< glm::u8vec4 > const &pixels, TextureData::Format format, bool mipmaps) {
+	if (size.x == 0 || size.y == 0 || pixels.size() != size_t(size.x) * size.y) {
+		throw std::runtime_error("make_texture: pixel count doesn't match " + std::to_string(size.x) + "x" + std::to_string(size.y) + " size.");
+	}
+
+	TextureData texture;
+	texture.header.format = format;
+	texture.header.width = size.x;
+	texture.header.height = size.y;
+
+	std::vector< glm::u8vec4 > level = pixels;
+	glm::uvec2 level_size = size;
+	while (true) {
+		TextureData::LevelInfo info;
+		info.width = level_size.x;
+		info.height = level_size.y;
+		info.begin = uint32_t(texture.data.size());
+		texture.data.resize(texture.data.size() + texture_level_bytes(format, level_size.x, level_size.y));
+		info.end = uint32_t(texture.data.size());
+		texture.levels.emplace_back(info);
+
+		uint8_t *out = texture.data.data() + info.begin;
+		if (format == TextureData::RGBA8) {
+			std::copy(level.begin(), level.end(), reinterpret_cast< glm::u8vec4 * >(out));
+		} else {
+			//encode 4x4 blocks (repeating edge pixels to fill partial blocks):
+			for (uint32_t by = 0; by < level_size.y; by += 4) {
+				for (uint32_t bx = 0; bx < level_size.x; bx += 4) {
+					glm::u8vec4 block[16];
+					for (uint32_t j = 0; j < 4; ++j) {
+						for (uint32_t i = 0; i < 4; ++i) {
+							uint32_t x = std::min(bx + i, level_size.x - 1);
+							uint32_t y = std::min(by + j, level_size.y - 1);
+							block[j * 4 + i] = level[size_t(y) * level_size.x + x];
+						}
+					}
+					if (format == TextureData::BC3) {
+						encode_alpha_block(block, out);
+						out += 8;
+					}
+					encode_color_block(block, out);
+					out += 8;
+				}
+			}
+		}
+
+		if (!mipmaps || (level_size.x == 1 && level_size.y == 1)) break;
+
+		//next level is a 2x2 box filter of this one:
+		glm::uvec2 next_size = glm::max(glm::uvec2(1), level_size / 2u);
+		std::vector< glm::u8vec4 > next(size_t(next_size.x) * next_size.y);
+		for (uint32_t y = 0; y < next_size.y; ++y) {
+			for (uint32_t x = 0; x < next_size.x; ++x) {
+				uint32_t x0 = std::min(2 * x, level_size.x - 1), x1 = std::min(2 * x + 1, level_size.x - 1);
+				uint32_t y0 = std::min(2 * y, level_size.y - 1), y1 = std::min(2 * y + 1, level_size.y - 1);
+				glm::u8vec4 const &a = level[size_t(y0) * level_size.x + x0];
+				glm::u8vec4 const &b = level[size_t(y0) * level_size.x + x1];
+				glm::u8vec4 const &c = level[size_t(y1) * level_size.x + x0];
+				glm::u8vec4 const &d = level[size_t(y1) * level_size.x + x1];
+				glm::u8vec4 &o = next[size_t(y) * next_size.x + x];
+				for (uint32_t ch = 0; ch < 4; ++ch) {
+					o[ch] = uint8_t((uint32_t(a[ch]) + uint32_t(b[ch]) + uint32_t(c[ch]) + uint32_t(d[ch]) + 2) / 4);
+				}
+			}
+		}
+		level = std::move(next);
+		level_size = next_size;
+	}
+	texture.header.levels = uint32_t(texture.levels.size());
+
+	return texture;
+}
+
+std::vector< glm::u8vec4 > decompress_level(TextureData const &texture, uint32_t l) {
+	assert(l < texture.levels.size());
+	TextureData::LevelInfo const &level = texture.levels[l];
+	uint8_t const *in = texture.data.data() + level.begin;
+
+	std::vector< glm::u8vec4 > pixels(size_t(level.width) * level.height);
+	if (texture.header.format == TextureData::RGBA8) {
+		std::copy(in, in + pixels.size() * 4, reinterpret_cast< uint8_t * >(pixels.data()));
+		return pixels;
+	}
+
+	for (uint32_t by = 0; by < level.height; by += 4) {
+		for (uint32_t bx = 0; bx < level.width; bx += 4) {
+			glm::u8vec4 block[16];
+			if (texture.header.format == TextureData::BC3) {
+				decode_color_block(in + 8, false, block);
+				decode_alpha_block(in, block);
+				in += 16;
+			} else {
+				decode_color_block(in, true, block);
+				in += 8;
+			}
+			for (uint32_t j = 0; j < 4 && by + j < level.height; ++j) {
+				for (uint32_t i = 0; i < 4 && bx + i < level.width; ++i) {
+					pixels[size_t(by + j) * level.width + (bx + i)] = block[j * 4 + i];
+				}
+			}
+		}
+	}
+	return pixels;
+}
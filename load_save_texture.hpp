@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Load and save textures in a GPU-ready chunked format (see read_write_chunk.hpp):
+ *  'tex0' -- one TextureData::Header
+ *  'mip0' -- one TextureData::LevelInfo per mip level (largest first)
+ *  'dat0' -- all levels' pixels or blocks, back to back
+ *
+ * Pixels are stored with a lower-left origin (as OpenGL expects).
+ * BC1/BC3 data is S3TC (a.k.a. DXT1/DXT5) blocks that can be handed straight to glCompressedTexImage2D.
+ *
+ * Build these files from PNGs with the 'texture-pack' tool.
+ */
+
+struct TextureData {
+	enum Format : uint32_t {
+		RGBA8 = 0, //uncompressed, 4 bytes per pixel
+		BC1 = 1, //4x4 blocks of RGB in 8 bytes (alpha is ignored)
+		BC3 = 2, //4x4 blocks of RGBA in 16 bytes
+	};
+	struct Header {
+		Format format = RGBA8;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t levels = 0;
+	};
+	static_assert(sizeof(Header) == 16, "Header is packed.");
+	struct LevelInfo {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t begin = 0; //byte range in data
+		uint32_t end = 0;
+	};
+	static_assert(sizeof(LevelInfo) == 16, "LevelInfo is packed.");
+
+	Header header;
+	std::vector< LevelInfo > levels;
+	std::vector< uint8_t > data;
+};
+
+//NOTE: load_texture and save_texture will throw on error
+void load_texture(std::string const &filename, TextureData *texture);
+void save_texture(std::string const &filename, TextureData const &texture);
+
+//Build a texture (with a full mip chain if 'mipmaps' is set) from RGBA pixels (lower-left origin):
+// (BC1/BC3 encoding is done here -- slow-ish, meant for offline use)
+TextureData make_texture(glm::uvec2 size, std::vector< glm::u8vec4 > const &pixels, TextureData::Format format, bool mipmaps);
+
+//Expand BC1/BC3 blocks back to RGBA pixels (for GL implementations without S3TC support):
+std::vector< glm::u8vec4 > decompress_level(TextureData const &texture, uint32_t level);
+
+//size, in bytes, of a w x h image in the given format:
+uint32_t texture_level_bytes(TextureData::Format format, uint32_t width, uint32_t height);
@@ -1,4 +1,5 @@
 #include "load_wav.hpp"
+#include "resample.hpp"
 
 #include <SDL.h>
 
@@ -22,10 +23,12 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	}
 
 	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
+	// (SDL converts format and channel count; rate conversion is done below with a windowed-sinc resampler,
+	//  which sounds better than SDL's built-in rate conversion)
 	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
+	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, have->freq);
 	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+		std::cout << "WAV file '" + filename + "' didn't load as float32, mono; converting." << std::endl;
 		cvt.len = audio_len;
 		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
 		SDL_memcpy(cvt.buf, audio_buf, audio_len);
@@ -38,6 +41,12 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	} else {
 		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
 	}
+	if (uint32_t(have->freq) != AUDIO_RATE) {
+		std::cout << "WAV file '" + filename + "' is " + std::to_string(have->freq) + " Hz; resampling to " + std::to_string(AUDIO_RATE) + " Hz." << std::endl;
+		std::vector< float > resampled;
+		Resample::convert(data, uint32_t(have->freq), AUDIO_RATE, &resampled);
+		data = std::move(resampled);
+	}
 	SDL_FreeWAV(audio_buf);
 
 	float min = 0.0f;
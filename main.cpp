@@ -14,7 +14,10 @@
 #include "GL.hpp"
 
 //for screenshots:
-#include "load_save_png.hpp"
+#include "FrameCapture.hpp"
+
+//for shader hot-reloading:
+#include "ShaderWatcher.hpp"
 
 //Includes for libSDL:
 #include <SDL.h>
@@ -25,6 +28,7 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <cstdlib>
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -45,6 +49,32 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------  command line ------------
+	//record mode (for capturing gameplay, e.g. on headless machines):
+	//  --record <path>       record frames; a path ending in .y4m is written as one video, otherwise as <path>-000000.png, ...
+	//  --record-every <N>    only record every Nth frame (default: 1)
+	//  --record-fps <N>      frame rate written into .y4m header (default: 60)
+	//development:
+	//  --watch-shaders       read shader sources from dist/shaders/ and rebuild programs when they change
+	std::string record_path;
+	uint32_t record_every = 1;
+	uint32_t record_fps = 60;
+	bool watch_shaders = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--record" && i + 1 < argc) {
+			record_path = argv[++i];
+		} else if (arg == "--record-every" && i + 1 < argc) {
+			record_every = uint32_t(std::max(1, std::atoi(argv[++i])));
+		} else if (arg == "--record-fps" && i + 1 < argc) {
+			record_fps = uint32_t(std::max(1, std::atoi(argv[++i])));
+		} else if (arg == "--watch-shaders") {
+			watch_shaders = true;
+		} else {
+			std::cerr << "WARNING: ignoring unknown command-line option '" << arg << "'. (Known: --record <path[.y4m]> --record-every <N> --record-fps <N> --watch-shaders)" << std::endl;
+		}
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -109,11 +139,20 @@ int main(int argc, char **argv) {
 	Sound::init();
 
 	//------------ load assets --------------
+	if (watch_shaders) enable_shader_watching();
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
 	Mode::set_current(std::make_shared< PlayMode >());
 
+	//------------ screenshots are read back + saved asynchronously --------------
+	std::unique_ptr< FrameCapture > frame_capture(new FrameCapture());
+	std::string screenshot_filename; //set when a screenshot has been requested
+	if (!record_path.empty()) {
+		bool y4m = record_path.size() >= 4 && record_path.substr(record_path.size() - 4) == ".y4m";
+		frame_capture->start_recording(record_path, (y4m ? FrameCapture::Y4M : FrameCapture::PNGSequence), record_every, record_fps);
+	}
+
 	//------------ main loop ------------
 
 	//this inline function will be called whenever the window is resized,
@@ -151,18 +190,8 @@ int main(int argc, char **argv) {
 					break;
 				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_PRINTSCREEN) {
 					// --- screenshot key ---
-					std::string filename = "screenshot.png";
-					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
-					int w,h;
-					SDL_GL_GetDrawableSize(window, &w, &h);
-					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-					for (auto &px : data) {
-						px.a = 0xff;
-					}
-					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+					// (captured after the next frame is drawn; see below)
+					screenshot_filename = "screenshot.png";
 				}
 			}
 			if (!Mode::current) break;
@@ -183,16 +212,30 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			poll_shader_watcher(); //(swaps in any rebuilt shader programs)
 			Mode::current->draw(drawable_size);
 		}
 
+		{ //(4) start reading back this frame if a screenshot was requested (or recording), and pass along any finished readbacks:
+			frame_capture->record_frame(drawable_size);
+			if (!screenshot_filename.empty()) {
+				std::cout << "Saving screenshot to '" << screenshot_filename << "'." << std::endl;
+				if (!frame_capture->capture(drawable_size, screenshot_filename)) {
+					std::cerr << "WARNING: too many screenshots in flight; skipping this one." << std::endl;
+				}
+				screenshot_filename = "";
+			}
+			frame_capture->poll();
+		}
+
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(window);
 	}
 
 
 	//------------  teardown ------------
+	frame_capture.reset(); //(finishes any pending screenshots and recording)
+
 	Sound::shutdown();
 
 	SDL_GL_DeleteContext(context);
@@ -0,0 +1,99 @@
+#include "load_save_png.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+//This program measures how quickly save_png (libpng, one thread) and the multi-threaded encoder
+// compress an image, and checks that the multi-threaded encoder's output loads back correctly.
+//
+//usage: png-bench [image.png] [iterations]
+// (without an image, a 1920x1080 test image that looks a bit like a game frame is used)
+
+int main(int argc, char **argv) {
+	glm::uvec2 size(1920, 1080);
+	std::vector< glm::u8vec4 > data;
+	uint32_t iterations = 5;
+
+	if (argc > 1) {
+		load_png(argv[1], &size, &data, UpperLeftOrigin);
+		std::cout << "Loaded " << size.x << "x" << size.y << " image from '" << argv[1] << "'." << std::endl;
+	} else {
+		//smooth gradients, flat-shaded blocks, and a bit of noise:
+		std::mt19937 mt(0x15466);
+		data.resize(size.x * size.y);
+		for (uint32_t y = 0; y < size.y; ++y) {
+			for (uint32_t x = 0; x < size.x; ++x) {
+				glm::u8vec4 &px = data[y * size.x + x];
+				if (((x / 160) + (y / 120)) % 3 == 0) {
+					px = glm::u8vec4(40, 80 + (x / 160) * 10, 120, 0xff);
+				} else {
+					px = glm::u8vec4(uint8_t(x * 255 / size.x), uint8_t(y * 255 / size.y), uint8_t((x + y) / 12), 0xff);
+				}
+				if (mt() % 8 == 0) px.r = uint8_t(px.r + mt() % 5);
+			}
+		}
+	}
+	if (argc > 2) iterations = uint32_t(std::max(1, std::atoi(argv[2])));
+
+	double const megabytes = double(data.size()) * 4.0 / (1024.0 * 1024.0);
+	std::string const out = "png-bench-out.png";
+
+	auto file_size = [&]() -> size_t {
+		std::ifstream file(out, std::ios::binary | std::ios::ate);
+		return size_t(file.tellg());
+	};
+
+	auto report = [&](std::string const &name, double seconds) {
+		std::cout << "  " << name << ": " << (seconds / iterations * 1000.0) << " ms/image, "
+			<< (megabytes * iterations / seconds) << " MB/s, " << file_size() << " bytes." << std::endl;
+	};
+
+	{ //libpng:
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < iterations; ++i) {
+			save_png(out, size, data.data(), UpperLeftOrigin);
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		report("libpng (current)", std::chrono::duration< double >(after - before).count());
+	}
+
+	struct Mode {
+		std::string name;
+		PNGSaveOptions options;
+	};
+	PNGSaveOptions one_thread;
+	one_thread.threads = 1;
+	PNGSaveOptions smallest;
+	smallest.level = 9;
+	for (Mode const &mode : {
+		Mode{"threaded, default, 1 thread", one_thread},
+		Mode{"threaded, default", PNGSaveOptions()},
+		Mode{"threaded, fast", PNGSaveOptions::fast()},
+		Mode{"threaded, level 9", smallest},
+	}) {
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < iterations; ++i) {
+			save_png(out, size, data.data(), UpperLeftOrigin, mode.options);
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		report(mode.name, std::chrono::duration< double >(after - before).count());
+
+		//check round trip:
+		glm::uvec2 check_size;
+		std::vector< glm::u8vec4 > check;
+		load_png(out, &check_size, &check, UpperLeftOrigin);
+		if (check_size != size || check != data) {
+			std::cerr << "ERROR: '" << mode.name << "' output doesn't match the input image." << std::endl;
+			return 1;
+		}
+	}
+
+	std::remove(out.c_str());
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include "resample.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RESAMPLE_USE_SSE
+#endif
+
+namespace {
+	//number of fractional positions with precomputed filter coefficients:
+	// (positions in between are handled by blending adjacent phases)
+	constexpr uint32_t const PHASES = 64;
+
+	//fraction of the input Nyquist frequency passed by the filter:
+	constexpr float const CUTOFF = 0.9f;
+
+	constexpr float const PI = 3.1415926f;
+
+	//Blackman-windowed sinc, for x (in input samples) from -half_width to half_width:
+	float windowed_sinc(float x, float cutoff, float half_width) {
+		if (std::abs(x) >= half_width) return 0.0f;
+		float s = (x == 0.0f ? 1.0f : std::sin(PI * cutoff * x) / (PI * cutoff * x));
+		float w = 0.42f + 0.5f * std::cos(PI * x / half_width) + 0.08f * std::cos(2.0f * PI * x / half_width);
+		return cutoff * s * w;
+	}
+
+	//filter coefficients; row p is for t == p / PHASES (the extra row makes blending at the end easy):
+	struct PhaseTable {
+		PhaseTable() {
+			for (uint32_t p = 0; p <= PHASES; ++p) {
+				float t = float(p) / float(PHASES);
+				float sum = 0.0f;
+				for (uint32_t k = 0; k < Resample::TAPS; ++k) {
+					float x = float(k) - float(Resample::BEFORE) - t;
+					rows[p][k] = windowed_sinc(x, CUTOFF, float(Resample::TAPS / 2));
+					sum += rows[p][k];
+				}
+				//normalize so that DC passes at unit gain:
+				for (uint32_t k = 0; k < Resample::TAPS; ++k) {
+					rows[p][k] /= sum;
+				}
+			}
+		}
+		alignas(16) float rows[PHASES + 1][Resample::TAPS];
+	};
+	PhaseTable const phase_table;
+}
+
+float Resample::sinc(float const *window, float t) {
+	assert(window);
+	float p = t * float(PHASES);
+	uint32_t phase = uint32_t(p);
+	float blend = p - float(phase);
+	if (phase >= PHASES) {
+		phase = PHASES - 1;
+		blend = 1.0f;
+	}
+	float const *a = phase_table.rows[phase];
+	float const *b = phase_table.rows[phase + 1];
+
+#ifdef RESAMPLE_USE_SSE
+	static_assert(TAPS % 4 == 0, "taps can be processed four at a time");
+	__m128 sum_a = _mm_setzero_ps();
+	__m128 sum_b = _mm_setzero_ps();
+	for (uint32_t k = 0; k < TAPS; k += 4) {
+		__m128 x = _mm_loadu_ps(window + k);
+		sum_a = _mm_add_ps(sum_a, _mm_mul_ps(x, _mm_load_ps(a + k)));
+		sum_b = _mm_add_ps(sum_b, _mm_mul_ps(x, _mm_load_ps(b + k)));
+	}
+	__m128 sum = _mm_add_ps(sum_a, _mm_mul_ps(_mm_sub_ps(sum_b, sum_a), _mm_set1_ps(blend)));
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, sum);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+	float sum_a = 0.0f;
+	float sum_b = 0.0f;
+	for (uint32_t k = 0; k < TAPS; ++k) {
+		sum_a += window[k] * a[k];
+		sum_b += window[k] * b[k];
+	}
+	return sum_a + (sum_b - sum_a) * blend;
+#endif
+}
+
+void Resample::convert(std::vector< float > const &from, uint32_t from_rate, uint32_t to_rate, std::vector< float > *to_) {
+	assert(to_);
+	auto &to = *to_;
+	assert(from_rate > 0 && to_rate > 0);
+
+	if (from_rate == to_rate) {
+		to = from;
+		return;
+	}
+
+	//when reducing the rate, filter below the new Nyquist frequency (and widen the filter to match):
+	double step = double(from_rate) / double(to_rate);
+	float cutoff = CUTOFF * float(std::min(1.0, 1.0 / step));
+	float half_width = float(TAPS / 2) * (CUTOFF / cutoff);
+	int64_t reach = int64_t(std::ceil(half_width));
+
+	to.assign(size_t(std::floor(double(from.size()) / step)), 0.0f);
+	for (size_t n = 0; n < to.size(); ++n) {
+		double position = double(n) * step;
+		int64_t i = int64_t(std::floor(position));
+		float t = float(position - double(i));
+		float sum = 0.0f;
+		float weight = 0.0f;
+		for (int64_t j = i - reach + 1; j <= i + reach; ++j) {
+			float w = windowed_sinc(float(j - i) - t, cutoff, half_width);
+			weight += w;
+			if (j >= 0 && j < int64_t(from.size())) sum += w * from[size_t(j)];
+		}
+		to[n] = (weight != 0.0f ? sum / weight : 0.0f);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//Windowed-sinc resampling for mono floating-point audio.
+// Used by the Sound mixer (for non-1.0 playback rates) and when loading samples at other rates.
+
+namespace Resample {
+
+//number of input samples each output sample is computed from:
+constexpr uint32_t const TAPS = 16;
+
+//number of taps before the interpolated position:
+// (that is, interpolating at position i + t reads data[i - BEFORE] ... data[i - BEFORE + TAPS - 1])
+constexpr uint32_t const BEFORE = TAPS / 2 - 1;
+
+//interpolate at fractional position t (in [0,1)) using the TAPS values starting at 'window':
+// uses a precomputed polyphase table, so this is cheap enough to call per-sample in the mixer.
+float sinc(float const *window, float t);
+
+//convert a whole buffer from one sampling rate to another:
+// (slower than 'sinc' but band-limits properly when reducing the rate)
+void convert(std::vector< float > const &from, uint32_t from_rate, uint32_t to_rate, std::vector< float > *to);
+
+} //namespace Resample
@@ -4,6 +4,8 @@
 #include "GL.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
+#include "LitColorTextureProgram.hpp"
+#include "ShaderWatcher.hpp"
 
 #include <SDL.h>
 
@@ -12,6 +14,7 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <vector>
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
@@ -19,6 +22,40 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------  command line ------------
+	//  show-scene [options] <path/to/scene.scene> [path/to/meshes.pnct]
+	//options:
+	//  --lit                 draw with LitColorTextureProgram (lit by the scene's lights) instead of ShowSceneProgram
+	//  --shadows             give spot and directional lights shadow maps (implies --lit)
+	//  --passes              depth pre-pass and sort drawables (see DrawPasses.hpp), printing per-pass GPU times
+	//  --no-prepass          (with --passes) only sort, to compare against the pre-pass
+	//  --watch-shaders       read shader sources from shaders/ (next to this program) and rebuild programs when they change
+	bool lit = false;
+	bool shadows = false;
+	bool passes = false;
+	bool prepass = true;
+	bool watch_shaders = false;
+	std::vector< std::string > args;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--lit") {
+			lit = true;
+		} else if (arg == "--shadows") {
+			shadows = true;
+			lit = true;
+		} else if (arg == "--passes") {
+			passes = true;
+		} else if (arg == "--no-prepass") {
+			prepass = false;
+		} else if (arg == "--watch-shaders") {
+			watch_shaders = true;
+		} else if (arg.size() > 2 && arg.substr(0, 2) == "--") {
+			std::cerr << "WARNING: ignoring unknown command-line option '" << arg << "'. (Known: --lit --shadows --passes --no-prepass --watch-shaders)" << std::endl;
+		} else {
+			args.emplace_back(arg);
+		}
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -77,17 +114,18 @@ int main(int argc, char **argv) {
 	}
 
 	//------------ load resources --------------
+	if (watch_shaders) enable_shader_watching();
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
 	bool usage = false;
 	std::string scene_file;
 	std::string meshes_file;
-	if (argc == 2) {
-		scene_file = argv[1];
-	} else if (argc == 3) {
-		scene_file = argv[1];
-		meshes_file = argv[2];
+	if (args.size() == 1) {
+		scene_file = args[0];
+	} else if (args.size() == 2) {
+		scene_file = args[0];
+		meshes_file = args[1];
 	} else {
 		usage = true;
 	}
@@ -96,7 +134,7 @@ int main(int argc, char **argv) {
 	if (meshes_file != "") {
 		try {
 			buffer = new MeshBuffer(meshes_file);
-			buffer_vao = buffer->make_vao_for_program(show_scene_program->program);
+			buffer_vao = buffer->make_vao_for_program(lit ? lit_color_texture_program->program : show_scene_program->program);
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading mesh buffer '" << meshes_file << "': " << e.what() << std::endl;
 			usage = true;
@@ -107,20 +145,23 @@ int main(int argc, char **argv) {
 	if (scene_file != "") {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+			scene->load(scene_file, [&buffer,&buffer_vao,lit](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 				if (!buffer_vao) return;
 				Mesh const &mesh = buffer->lookup(mesh_name);
 
 				scene.drawables.emplace_back(transform);
 				Scene::Drawable &drawable = scene.drawables.back();
 
-				drawable.pipeline = show_scene_program_pipeline;
+				drawable.pipeline = (lit ? lit_color_texture_program_pipeline : show_scene_program_pipeline);
 
 				drawable.pipeline.vao = buffer_vao;
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
 
+				drawable.bbox_min = mesh.min;
+				drawable.bbox_max = mesh.max;
+
 			});
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
@@ -132,7 +173,7 @@ int main(int argc, char **argv) {
 		usage = true;
 	}
 	if (usage) {
-		std::cerr << "Usage:\n\t" << argv[0] << " <path/to/scene.scene> [path/to/meshes.pnct]" << std::endl;
+		std::cerr << "Usage:\n\t" << argv[0] << " [--lit] [--shadows] [--passes [--no-prepass]] [--watch-shaders] <path/to/scene.scene> [path/to/meshes.pnct]" << std::endl;
 		return 1;
 	}
 	std::cout << "Showing scene from '" << scene_file << "' with";
@@ -141,7 +182,32 @@ int main(int argc, char **argv) {
 	} else {
 		std::cout << " no meshes -- consider passing a '.pnct' file as the second argument." << std::endl;
 	}
-	Mode::set_current(std::make_shared< ShowSceneMode >(*scene));
+	if (lit && scene->lights.empty()) {
+		std::cout << "NOTE: scene has no lights, so --lit will draw everything black." << std::endl;
+	}
+
+	//drawables copied the program's pipeline template, so point them at rebuilt programs:
+	add_shader_reload_listener([scene](GLuint old_program, GLuint new_program) {
+		for (Scene::Drawable::Pipeline const *pipeline : {&show_scene_program_pipeline, &lit_color_texture_program_pipeline}) {
+			if (new_program == pipeline->program) scene->replace_program(old_program, *pipeline);
+		}
+	});
+
+	auto mode = std::make_shared< ShowSceneMode >(*scene);
+	if (shadows) {
+		uint32_t casters = 0;
+		for (auto &light : scene->lights) {
+			light.shadows = (light.type == Scene::Light::Spot || light.type == Scene::Light::Directional);
+			if (light.shadows) casters += 1;
+		}
+		std::cout << casters << " of the scene's lights cast shadows." << std::endl;
+		mode->shadows = std::make_unique< ShadowAtlas >();
+	}
+	if (passes) {
+		mode->passes = std::make_unique< DrawPasses >();
+		mode->passes->depth_prepass = prepass;
+	}
+	Mode::set_current(mode);
 
 	//------------ main loop ------------
 
@@ -212,7 +278,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			poll_shader_watcher(); //(swaps in any rebuilt shader programs)
 			Mode::current->draw(drawable_size);
 		}
 
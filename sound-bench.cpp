@@ -0,0 +1,89 @@
+#include "Sound.hpp"
+#include "SoundEffects.hpp"
+
+#include <SDL.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+//This program measures how long the Sound mixer takes to mix a bunch of voices
+// at different playback rates and with different interpolation modes (and with a bus effects chain).
+
+//The mixer callback (defined in Sound.cpp) is called directly, so no audio device is needed:
+void mix_audio(void *, Uint8 *buffer_, int len);
+
+int main(int argc, char **argv) {
+	uint32_t voices = 64;
+	uint32_t periods = 500;
+	if (argc > 1) voices = uint32_t(std::atoi(argv[1]));
+	if (argc > 2) periods = uint32_t(std::atoi(argv[2]));
+
+	//should match the constants in Sound.cpp:
+	constexpr uint32_t const MIX_SAMPLES = 1024;
+	std::vector< float > buffer(MIX_SAMPLES * 2);
+	int len = int(buffer.size() * sizeof(float));
+
+	//a couple seconds of noise to play:
+	std::mt19937 mt(0x15466);
+	std::vector< float > noise(48000 * 2);
+	for (auto &n : noise) {
+		n = (mt() / float(mt.max())) * 2.0f - 1.0f;
+	}
+	Sound::Sample sample(noise);
+
+	struct Mode {
+		std::string name;
+		float rate;
+		Sound::PlayingSample::Interpolation interpolation;
+		bool effects = false; //play on a bus with a filter, compressor, and reverb
+	};
+	Sound::Bus *bus = Sound::get_bus("bench");
+	for (Mode const &mode : {
+		Mode{"rate 1.0 (no interpolation)", 1.0f, Sound::PlayingSample::Sinc},
+		Mode{"rate 1.37, linear", 1.37f, Sound::PlayingSample::Linear},
+		Mode{"rate 1.37, sinc", 1.37f, Sound::PlayingSample::Sinc},
+		Mode{"rate 0.71, sinc", 0.71f, Sound::PlayingSample::Sinc},
+		Mode{"rate 1.0, bus effects", 1.0f, Sound::PlayingSample::Sinc, true},
+	}) {
+		if (mode.effects) {
+			bus->add_effect(std::make_shared< Sound::Biquad >(Sound::Biquad::LowPass, 2000.0f));
+			bus->add_effect(std::make_shared< Sound::Compressor >(-6.0f, 4.0f));
+			bus->add_effect(std::make_shared< Sound::Reverb >());
+		}
+		for (uint32_t v = 0; v < voices; ++v) {
+			std::shared_ptr< Sound::PlayingSample > playing = Sound::loop(sample, 1.0f / voices, 0.0f, (mode.effects ? bus : nullptr));
+			playing->set_rate(mode.rate, 0.0f);
+			playing->set_interpolation(mode.interpolation);
+		}
+
+		//warm up:
+		for (uint32_t p = 0; p < 10; ++p) {
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(buffer.data()), len);
+		}
+
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t p = 0; p < periods; ++p) {
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(buffer.data()), len);
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+
+		Sound::MixerStats stats = Sound::get_mixer_stats();
+		float per_period = std::chrono::duration< float >(after - before).count() / periods;
+		std::cout << mode.name << ": " << voices << " voices, "
+			<< per_period * 1e6f << " us per mix period ("
+			<< 100.0f * per_period / stats.deadline << "% of deadline; "
+			<< per_period * 1e9f / (voices * MIX_SAMPLES) << " ns per voice-sample)" << std::endl;
+
+		//clear out playing samples (and effects) before the next mode:
+		Sound::stop_all_samples();
+		bus->clear_effects();
+		for (uint32_t p = 0; p < 4; ++p) {
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(buffer.data()), len);
+		}
+	}
+
+	return 0;
+}
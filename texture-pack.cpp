@@ -0,0 +1,66 @@
+#include "load_save_png.hpp"
+#include "load_save_texture.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+//This program converts a PNG into the texture format loaded by gl_load_texture (see load_save_texture.hpp),
+// building a mip chain and (optionally) compressing to BC1/BC3 ahead of time so the game doesn't have to.
+//
+//usage: texture-pack <in.png> <out.tex> [rgba8|bc1|bc3|auto] [--no-mipmaps]
+// 'auto' (the default) picks bc1 for opaque images and bc3 for images with alpha.
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.png> <out.tex> [rgba8|bc1|bc3|auto] [--no-mipmaps]" << std::endl;
+		return 1;
+	}
+	std::string in = argv[1];
+	std::string out = argv[2];
+	std::string format_name = "auto";
+	bool mipmaps = true;
+	for (int i = 3; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--no-mipmaps") mipmaps = false;
+		else format_name = arg;
+	}
+
+	try {
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > pixels;
+		load_png(in, &size, &pixels, LowerLeftOrigin);
+
+		TextureData::Format format;
+		if (format_name == "rgba8") format = TextureData::RGBA8;
+		else if (format_name == "bc1") format = TextureData::BC1;
+		else if (format_name == "bc3") format = TextureData::BC3;
+		else if (format_name == "auto") {
+			format = TextureData::BC1;
+			for (auto const &px : pixels) {
+				if (px.a != 0xff) {
+					format = TextureData::BC3;
+					break;
+				}
+			}
+		} else {
+			std::cerr << "Unknown format '" << format_name << "' (expecting rgba8, bc1, bc3, or auto)." << std::endl;
+			return 1;
+		}
+
+		auto before = std::chrono::high_resolution_clock::now();
+		TextureData texture = make_texture(size, pixels, format, mipmaps);
+		auto after = std::chrono::high_resolution_clock::now();
+		save_texture(out, texture);
+
+		static char const *names[] = {"rgba8", "bc1", "bc3"};
+		std::cout << "Wrote " << size.x << "x" << size.y << " " << names[format] << " texture with " << texture.levels.size() << " levels to '" << out << "': "
+			<< texture.data.size() << " bytes (vs. " << size_t(size.x) * size.y * 4 << " bytes for the RGBA8 base level alone); encoding took "
+			<< std::chrono::duration< double >(after - before).count() * 1000.0 << " ms." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}